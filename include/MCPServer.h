@@ -6,10 +6,20 @@
 #include <ESPAsyncWebServer.h>
 
 #include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
 #include "freertos/FreeRTOS.h"
@@ -53,42 +63,329 @@ extern const char* const DEFAULT_SERVER_VERSION;
 #define MCP_HTTP_FAST_PATH_WAIT_MS 20
 #endif
 
+// POST bodies buffered in slots of MCP_HTTP_MAX_BODY_SIZE reserved by begin().
+// Uploads beyond this many at once are buffered on the heap instead. Deferred
+// jobs get MCP_HTTP_JOB_QUEUE_DEPTH + 2 slots of their own: the queue, the
+// one running, and one still being sent. Either pool holds at most 32. Set to
+// 0 to buffer every body on the heap.
+#ifndef MCP_HTTP_BODY_POOL_SLOTS
+#define MCP_HTTP_BODY_POOL_SLOTS 2
+#endif
+
+// Size of the blocks a request arena takes from the heap; an allocation too
+// big for one gets a block of its own. Set to 0 to build every request
+// document straight on the heap.
+#ifndef MCP_REQUEST_ARENA_BLOCK_SIZE
+#define MCP_REQUEST_ARENA_BLOCK_SIZE 2048
+#endif
+
+// Buffers larger than this many bytes go to PSRAM on boards that have it: body
+// buffers, large arena blocks, the tools/list cache and serialized replies.
+// Anything smaller is kept in internal RAM, which WiFi and lwIP also need but
+// which is much faster. Without PSRAM, or with this set to 0, everything is
+// internal.
+#ifndef MCP_PSRAM_THRESHOLD
+#define MCP_PSRAM_THRESHOLD 4096
+#endif
+
+// Most tools a single tools/list reply lists. A larger catalog is paged with
+// MCP cursors, so the reply is bounded by the page rather than the catalog.
+// Set to 0 to always list every tool at once.
+#ifndef MCP_TOOLS_LIST_PAGE_SIZE
+#define MCP_TOOLS_LIST_PAGE_SIZE 32
+#endif
+
+// How often the worker task looks for lazily built tool handlers that have
+// sat unused past their Tool::idleTimeoutMs, when it has nothing else to do.
+#ifndef MCP_IDLE_SWEEP_MS
+#define MCP_IDLE_SWEEP_MS 5000
+#endif
+
 #ifdef MCP_HTTP_TEST_HOOKS
 /* Test-only: force the next `n` deferred-job allocations to fail (simulate
  * OOM). Compiled out of production builds. */
 void mcp_http_test_fail_next_job_alloc(int n);
 #endif
 
+/* Allocates `size` bytes where MCP_PSRAM_THRESHOLD places them; release with
+ * free(). Null only when neither heap can serve the request. */
+void* mcpPlacedAlloc(size_t size);
+
+/* Standard-library allocator over mcpPlacedAlloc, for the strings that can
+ * grow large: the tools/list cache, raw results and serialized replies. */
+template <typename T>
+struct PlacedAllocator {
+    using value_type = T;
+
+    PlacedAllocator() = default;
+    template <typename U>
+    PlacedAllocator(const PlacedAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        void* ptr = mcpPlacedAlloc(n * sizeof(T));
+        if (!ptr) {
+#if defined(__cpp_exceptions)
+            throw std::bad_alloc();
+#else
+            abort();  // what std::allocator does without exceptions
+#endif
+        }
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, size_t) { free(ptr); }
+};
+
+template <typename T, typename U>
+bool operator==(const PlacedAllocator<T>&, const PlacedAllocator<U>&) {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const PlacedAllocator<T>&, const PlacedAllocator<U>&) {
+    return false;
+}
+
+using PlacedString = std::basic_string<char, std::char_traits<char>, PlacedAllocator<char>>;
+
+/* Bump allocator behind the documents of one HTTP request.
+ *
+ * A request builds several JsonDocuments — its arguments and id, the reply's
+ * result, error and text — and each grows through many small mallocs. Over
+ * days of uptime that interleaving fragments the general heap. With an arena,
+ * they come out of a few large blocks instead, and all of it goes back in
+ * one step when the last owner of the request lets go: the request handler,
+ * or the deferred job.
+ *
+ * Memory is only reused when the most recent allocation is freed or resized,
+ * which is how ArduinoJson grows a string while parsing or trims its last
+ * pool. Everything else waits for the arena to die, so it suits short-lived
+ * requests and nothing else. */
+class MCPArena final : public ArduinoJson::Allocator {
+public:
+    // Blocks come from `upstream`; nullptr means the heap.
+    explicit MCPArena(ArduinoJson::Allocator* upstream = nullptr);
+    ~MCPArena();
+
+    MCPArena(const MCPArena&) = delete;
+    MCPArena& operator=(const MCPArena&) = delete;
+
+    void* allocate(size_t size) override;
+    void deallocate(void* ptr) override;
+    void* reallocate(void* ptr, size_t newSize) override;
+
+    // Blocks currently held from the upstream allocator.
+    size_t blockCount() const;
+
+    // Shared ownership of a heap-allocated arena; null when there is none.
+    class Ref {
+    public:
+        Ref() : arena_(nullptr) {}
+        explicit Ref(MCPArena* arena);  // shares an existing arena
+        Ref(const Ref& other) : Ref(other.arena_) {}
+        Ref(Ref&& other) noexcept : arena_(other.arena_) { other.arena_ = nullptr; }
+        Ref& operator=(const Ref&) = delete;
+        ~Ref();
+
+        MCPArena* get() const { return arena_; }
+
+    private:
+        friend class MCPArena;
+        struct Adopt {};
+        Ref(MCPArena* arena, Adopt) : arena_(arena) {}
+
+        MCPArena* arena_;
+    };
+
+    /* A new arena on the heap, or a null Ref when out of memory or when
+     * MCP_REQUEST_ARENA_BLOCK_SIZE is 0. */
+    static Ref create(ArduinoJson::Allocator* upstream = nullptr);
+
+    /* While a Scope is alive, the MCPRequest and MCPResponse documents
+     * constructed on its thread allocate through it. Outside any scope they
+     * use the heap, as plain JsonDocuments do. Scopes nest. */
+    class Scope {
+    public:
+        explicit Scope(ArduinoJson::Allocator* allocator);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        // The allocator in effect on this thread; never null.
+        static ArduinoJson::Allocator* allocator();
+
+    private:
+        ArduinoJson::Allocator* previous_;
+    };
+
+private:
+    struct Block;
+
+    void* allocateFrom(Block* block, size_t size);
+
+    ArduinoJson::Allocator* upstream_;
+    Block* blocks_;      // allocations come from the head
+    Block* lastBlock_;   // where last_ lives
+    void* last_;         // the most recent allocation, the only one resized in place
+    std::atomic<int> refs_;
+};
+
+/* A JSON-RPC id: null, a number or a string, held inline.
+ *
+ * An id used to be a JsonDocument of its own in both the request and the
+ * reply. Now the id's text sits in the object itself when it has at most
+ * kInline bytes, which covers the counters and short tokens clients send. A
+ * longer id spills to the heap. A number keeps the text it arrived as, so it
+ * is echoed back exactly. A string keeps its decoded value and is escaped
+ * again on output. */
+class MCPId {
+public:
+    enum class Kind : uint8_t {
+        NONE,  // null, which is also how an absent or malformed id is answered
+        NUMBER,
+        STRING,
+    };
+
+    MCPId() : inline_{} {}
+    // Implicit, so a parsed variant can be passed wherever an id is expected.
+    // Anything but a string or a number becomes null.
+    MCPId(JsonVariantConst value);
+    MCPId(const MCPId& other);
+    MCPId(MCPId&& other) noexcept;
+    MCPId& operator=(const MCPId& other);
+    MCPId& operator=(MCPId&& other) noexcept;
+    ~MCPId();
+
+    Kind kind() const { return kind_; }
+    bool isNull() const { return kind_ == Kind::NONE; }
+
+    // The number as sent, or the decoded string; NUL-terminated.
+    const char* text() const { return length_ <= kInline ? inline_ : heap_; }
+    size_t length() const { return length_; }
+
+    // The reads the tests and handlers used to make on the id's variant.
+    template <typename T>
+    T as() const {
+        if constexpr (std::is_same<T, const char*>::value) {
+            return kind_ == Kind::STRING ? text() : nullptr;
+        } else {
+            static_assert(std::is_arithmetic<T>::value, "an id reads as a string or a number");
+            if (kind_ != Kind::NUMBER) {
+                return T();
+            }
+            if (std::is_integral<T>::value && !std::strpbrk(text(), ".eE")) {
+                return static_cast<T>(std::strtoll(text(), nullptr, 10));
+            }
+            return static_cast<T>(std::strtod(text(), nullptr));
+        }
+    }
+
+private:
+    friend class MCPServer;
+
+    static constexpr size_t kInline = 23;
+
+    /* Room for `capacity` bytes of text; the id is built in place and then
+     * trimmed with setLength(). Null, leaving the id null, if a spill cannot be
+     * allocated. */
+    char* reserve(Kind kind, size_t capacity);
+    void setLength(size_t length);
+    void assign(Kind kind, const char* text, size_t length);
+    void release();
+
+    union {
+        char inline_[kInline + 1];
+        char* heap_;
+    };
+    uint32_t length_ = 0;
+    Kind kind_ = Kind::NONE;
+};
+
+// The methods the server knows by name. OTHER is any other method.
+enum class MCPMethod : uint8_t {
+    NONE,  // the envelope did not get as far as a method
+    INITIALIZE,
+    PING,
+    TOOLS_LIST,
+    TOOLS_CALL,
+    NOTIFICATIONS_INITIALIZED,
+    OTHER,
+};
+
 struct MCPRequest {
-    std::string method;
-
-    /* The parse result is retained whole and params() is a view into it, so a
-     * tools/call payload is never deep-copied out into a second document. The
-     * id keeps its own (scalar-sized) copy: parseRequest deliberately leaves it
-     * null for a malformed id so the reply carries id:null, which a view into
-     * doc could not express. */
-    JsonDocument doc;
-    JsonDocument idDoc;
-    bool hasIdField;
-    bool parseError;
-    bool invalidRequest;
+    /* The envelope is scanned in place and only the part of params a handler
+     * reads is ever built into a tree: params whole for initialize and
+     * tools/list, params.arguments alone for tools/call (whose name is lifted
+     * into name; _meta and anything else is never materialized), filtered
+     * down to the members the tool's inputSchema declares. Unknown
+     * methods and notifications get no tree at all. The tree allocates from
+     * the MCPArena::Scope in effect when the request is constructed. */
+    JsonDocument doc{MCPArena::Scope::allocator()};
+
+    // Left null for a malformed id, so the reply carries id:null.
+    MCPId rpcId;
+
+    /* tools/call: params.name, when hasToolName. An unknown method: the
+     * method itself, for the error message. Empty otherwise. */
+    std::string name;
+
+    /* tools/call: why the tool's inputSchema rejects the arguments, when
+     * materializeRequest() checked them; empty when they pass. */
+    std::string argumentsProblem;
+
+    /* Raw JSON still to be built into doc — a span into the request body, so
+     * it is only valid until the body is released. Cleared by
+     * materializeRequest(). */
+    const char* payloadJson;
+    size_t payloadLength;
+
+    MCPMethod method;
+    // tools/call only. False when params is not an object or its name is
+    // missing or not a string.
+    bool hasToolName : 1;
+    // params.arguments was present but is not an object.
+    bool invalidArguments : 1;
+    bool hasIdField : 1;
+    bool parseError : 1;
+    bool invalidRequest : 1;
     // Set only once params has passed validation, so the early-return paths
     // expose no params at all.
-    bool paramsChecked;
+    bool paramsChecked : 1;
+    // tools/call: the arguments have been through checkArguments().
+    bool argumentsChecked : 1;
 
     MCPRequest()
-        : method(""), hasIdField(false), parseError(false), invalidRequest(false), paramsChecked(false) {}
+        : payloadJson(nullptr),
+          payloadLength(0),
+          method(MCPMethod::NONE),
+          hasToolName(false),
+          invalidArguments(false),
+          hasIdField(false),
+          parseError(false),
+          invalidRequest(false),
+          paramsChecked(false),
+          argumentsChecked(false) {}
 
+    /* params, as built. Null for tools/call, whose params are never built
+     * whole: read params.name from name and params.arguments from
+     * arguments(). */
     JsonVariantConst params() const {
-        return paramsChecked ? doc["params"] : JsonVariantConst();
+        return paramsChecked && method != MCPMethod::TOOLS_CALL ? doc.as<JsonVariantConst>() : JsonVariantConst();
+    }
+
+    // tools/call: params.arguments, filtered as described above. Null for any other method.
+    JsonVariantConst arguments() const {
+        return paramsChecked && method == MCPMethod::TOOLS_CALL ? doc.as<JsonVariantConst>() : JsonVariantConst();
     }
 
-    JsonVariantConst id() const {
-        return idDoc.as<JsonVariantConst>();
+    const MCPId& id() const {
+        return rpcId;
     }
 
+    // Whether a tree was built: params, or for tools/call its arguments.
     bool hasParams() const {
-        return paramsChecked && !doc["params"].isNull();
+        return paramsChecked && !doc.isNull();
     }
 
     bool isNotification() const {
@@ -96,48 +393,105 @@ struct MCPRequest {
     }
 };
 
+class JsonText;
+
+/* A reply: its id, and at most one of a result tree, a pre-serialized result
+ * or an error object. Those three share one slot, so a reply is as large as
+ * one document however it is answered. */
 struct MCPResponse {
-    JsonDocument idDoc;
-    JsonDocument resultDoc;
-    JsonDocument errorDoc;
+    enum class Kind : uint8_t {
+        NONE,    // neither result nor error
+        RESULT,  // document() is the result, or its text payload; see TextSource
+        RAW,     // raw() is the result, already serialized and shared
+        ERROR,   // document() is the error object
+    };
 
-    /* Already-serialized result JSON, spliced straight into the reply. Lets a
-     * handler hand back a cached body (tools/list) without rebuilding the tree
-     * and without a document-to-document deep copy. Takes precedence over
-     * resultDoc when non-empty. */
-    std::string rawResult;
+    /* tools/call text content, written late. Rather than holding the
+     * payload's JSON as a String in the result, only to escape it again on
+     * output, serializeResponse serializes the payload itself straight into
+     * content[0].text; the text exists only on the wire. */
+    enum class TextSource : uint8_t {
+        NONE,
+        // document() is the payload itself. The result is just the text
+        // content and isError, taken from toolError.
+        PAYLOAD,
+        // document() is the result; its structuredContent is also the text.
+        STRUCTURED,
+    };
 
+    MCPId rpcId;
     int code;
+    TextSource textSource;
+    bool toolError;  // isError of a PAYLOAD result
     bool body;
 
-    MCPResponse() : code(200), body(true) {}
-    MCPResponse(const JsonVariantConst& id) : code(200), body(true) {
-        idDoc.set(id);
+    MCPResponse() : code(200), textSource(TextSource::NONE), toolError(false), body(true) {}
+    MCPResponse(const MCPId& id)
+        : rpcId(id), code(200), textSource(TextSource::NONE), toolError(false), body(true) {}
+    MCPResponse(int code, const MCPId& id)
+        : rpcId(id), code(code), textSource(TextSource::NONE), toolError(false), body(true) {}
+    // A variant would otherwise convert to the id and to `body` equally well.
+    MCPResponse(int code, JsonVariantConst id) : MCPResponse(code, MCPId(id)) {}
+    MCPResponse(int code, bool body) : code(code), textSource(TextSource::NONE), toolError(false), body(body) {}
+    MCPResponse(const MCPResponse& other);
+    MCPResponse(MCPResponse&& other) noexcept;
+    MCPResponse& operator=(const MCPResponse& other);
+    MCPResponse& operator=(MCPResponse&& other) noexcept;
+    ~MCPResponse() { reset(Kind::NONE); }
+
+    /* Turn the reply into that kind, keeping its contents if it already is
+     * one, and return the storage to fill in. A new document allocates from
+     * the MCPArena::Scope in effect at the call. */
+    JsonDocument& resultDoc();
+    JsonDocument& errorDoc();
+    /* A serialized result is shared rather than copied: the reply holds a
+     * reference to the buffer, which must not change while it is held. */
+    std::shared_ptr<const JsonText>& rawResult();
+
+    Kind kind() const {
+        return kind_;
     }
-    MCPResponse(int code, const JsonVariantConst& id) : code(code), body(true) {
-        idDoc.set(id);
+    const MCPId& id() const {
+        return rpcId;
     }
-    MCPResponse(int code, bool body) : code(code), body(body) {}
-
-    JsonVariantConst id() const {
-        return idDoc.as<JsonVariantConst>();
+    // Only for RESULT and ERROR.
+    const JsonDocument& document() const {
+        return slot_.doc;
     }
+    // Only for RAW, once rawResult() has been set.
+    const std::shared_ptr<const JsonText>& raw() const {
+        return slot_.raw;
+    }
+
     JsonVariantConst result() const {
-        return resultDoc.as<JsonVariantConst>();
+        return kind_ == Kind::RESULT ? slot_.doc.as<JsonVariantConst>() : JsonVariantConst();
     }
     JsonVariantConst error() const {
-        return errorDoc.as<JsonVariantConst>();
+        return kind_ == Kind::ERROR ? slot_.doc.as<JsonVariantConst>() : JsonVariantConst();
     }
 
     bool hasResult() const {
-        return !rawResult.empty() || !resultDoc.isNull();
+        return kind_ == Kind::RESULT || kind_ == Kind::RAW;
     }
     bool hasError() const {
-        return !errorDoc.isNull();
+        return kind_ == Kind::ERROR;
     }
     bool hasBody() const {
         return body;
     }
+
+private:
+    void reset(Kind kind);
+    void copyBody(const MCPResponse& other);
+    void takeBody(MCPResponse& other);
+
+    Kind kind_ = Kind::NONE;  // packs in beside the public flags
+    union Slot {
+        Slot() {}
+        ~Slot() {}
+        JsonDocument doc;
+        std::shared_ptr<const JsonText> raw;
+    } slot_;
 };
 
 // JSON-RPC error codes
@@ -150,99 +504,470 @@ enum class ErrorCode {
     PARSE_ERROR = -32700
 };
 
-// Fluent JSON Schema builder
+/* Fluent JSON Schema builder.
+ *
+ * A Schema does not own a document. Every schema built on a thread goes into
+ * one shared store: its keywords are members of a single backing JsonDocument,
+ * and property(), items() and the composition keywords link the child to its
+ * parent rather than copying it in. build() then writes the tree out once, so
+ * nesting costs nothing per level. Copying a Schema still copies it.
+ *
+ * The store is released with the last Schema that uses it, normally at the end
+ * of the statement that calls build(). A Schema kept longer keeps the store,
+ * but each node is freed with the last Schema or parent holding it, and its
+ * space reused, so the store holds no more than the schemas still alive. Its
+ * document allocates from the
+ * MCPArena::Scope in effect when it was created, and must not outlive it. A
+ * Schema is built on one thread. */
 class Schema {
 public:
     Schema() = default;
+    Schema(const Schema& other);
+    Schema(Schema&& other) noexcept;
+    Schema& operator=(const Schema& other);
+    Schema& operator=(Schema&& other) noexcept;
+    ~Schema();
 
     // Type factory methods
-    static Schema object()  { Schema s; s.doc_["type"] = "object"; s.doc_["properties"].to<JsonObject>(); return s; }
-    static Schema string()  { Schema s; s.doc_["type"] = "string";  return s; }
-    static Schema integer() { Schema s; s.doc_["type"] = "integer"; return s; }
-    static Schema number()  { Schema s; s.doc_["type"] = "number";  return s; }
-    static Schema boolean() { Schema s; s.doc_["type"] = "boolean"; return s; }
-    static Schema array()   { Schema s; s.doc_["type"] = "array";   return s; }
-    static Schema null()    { Schema s; s.doc_["type"] = "null";    return s; }
+    static Schema object()  { Schema s; s.keywords()["type"] = "object"; s.keywords()["properties"].to<JsonObject>(); return s; }
+    static Schema string()  { Schema s; s.keywords()["type"] = "string";  return s; }
+    static Schema integer() { Schema s; s.keywords()["type"] = "integer"; return s; }
+    static Schema number()  { Schema s; s.keywords()["type"] = "number";  return s; }
+    static Schema boolean() { Schema s; s.keywords()["type"] = "boolean"; return s; }
+    static Schema array()   { Schema s; s.keywords()["type"] = "array";   return s; }
+    static Schema null()    { Schema s; s.keywords()["type"] = "null";    return s; }
 
     // Common modifiers
-    Schema& description(const char* desc) { doc_["description"] = desc; return *this; }
-    Schema& title(const char* t)          { doc_["title"] = t;         return *this; }
-    Schema& format(const char* f)         { doc_["format"] = f;        return *this; }
+    Schema& description(const char* desc) { keywords()["description"] = desc; return *this; }
+    Schema& title(const char* t)          { keywords()["title"] = t;         return *this; }
+    Schema& format(const char* f)         { keywords()["format"] = f;        return *this; }
 
     // Default value (supports any JSON type)
     template <typename T>
-    Schema& defaultValue(T value) { doc_["default"] = value; return *this; }
+    Schema& defaultValue(T value) { keywords()["default"] = value; return *this; }
 
     // Object modifiers
     Schema& property(const char* name, Schema prop) {
-        doc_["properties"][name].set(prop.doc_);
-        return *this;
+        return link(Slot::PROPERTIES, name, prop);
     }
     Schema& required(std::initializer_list<const char*> fields) {
-        for (auto& f : fields) doc_["required"].add(f);
+        for (auto& f : fields) keywords()["required"].add(f);
         return *this;
     }
     Schema& additionalProperties(bool v) {
-        doc_["additionalProperties"] = v;
+        keywords()["additionalProperties"] = v;
         return *this;
     }
 
     // Array modifiers
     Schema& items(Schema item) {
-        doc_["items"].set(item.doc_);
-        return *this;
+        return link(Slot::ITEMS, nullptr, item);
     }
-    Schema& minItems(int n) { doc_["minItems"] = n; return *this; }
-    Schema& maxItems(int n) { doc_["maxItems"] = n; return *this; }
+    Schema& minItems(int n) { keywords()["minItems"] = n; return *this; }
+    Schema& maxItems(int n) { keywords()["maxItems"] = n; return *this; }
 
     // Number/integer modifiers
-    Schema& minimum(double v)          { doc_["minimum"] = v;          return *this; }
-    Schema& maximum(double v)          { doc_["maximum"] = v;          return *this; }
-    Schema& exclusiveMinimum(double v) { doc_["exclusiveMinimum"] = v; return *this; }
-    Schema& exclusiveMaximum(double v) { doc_["exclusiveMaximum"] = v; return *this; }
-    Schema& multipleOf(double v)       { doc_["multipleOf"] = v;       return *this; }
+    Schema& minimum(double v)          { keywords()["minimum"] = v;          return *this; }
+    Schema& maximum(double v)          { keywords()["maximum"] = v;          return *this; }
+    Schema& exclusiveMinimum(double v) { keywords()["exclusiveMinimum"] = v; return *this; }
+    Schema& exclusiveMaximum(double v) { keywords()["exclusiveMaximum"] = v; return *this; }
+    Schema& multipleOf(double v)       { keywords()["multipleOf"] = v;       return *this; }
 
     // String modifiers
-    Schema& minLength(int n) { doc_["minLength"] = n; return *this; }
-    Schema& maxLength(int n) { doc_["maxLength"] = n; return *this; }
-    Schema& pattern(const char* p) { doc_["pattern"] = p; return *this; }
+    Schema& minLength(int n) { keywords()["minLength"] = n; return *this; }
+    Schema& maxLength(int n) { keywords()["maxLength"] = n; return *this; }
+    Schema& pattern(const char* p) { keywords()["pattern"] = p; return *this; }
 
     // Enum
     Schema& enumValues(std::initializer_list<const char*> vals) {
-        for (auto& v : vals) doc_["enum"].add(v);
+        for (auto& v : vals) keywords()["enum"].add(v);
         return *this;
     }
     // Enum for numeric values
     template <typename T>
     Schema& enumValues(std::initializer_list<T> vals) {
-        for (auto& v : vals) doc_["enum"].add(v);
+        for (auto& v : vals) keywords()["enum"].add(v);
         return *this;
     }
 
     // Composition
     Schema& oneOf(std::initializer_list<Schema> schemas) {
-        for (auto& s : schemas) doc_["oneOf"].add(s.doc_);
+        for (auto& s : schemas) link(Slot::ONE_OF, nullptr, s);
         return *this;
     }
     Schema& anyOf(std::initializer_list<Schema> schemas) {
-        for (auto& s : schemas) doc_["anyOf"].add(s.doc_);
+        for (auto& s : schemas) link(Slot::ANY_OF, nullptr, s);
         return *this;
     }
     Schema& allOf(std::initializer_list<Schema> schemas) {
-        for (auto& s : schemas) doc_["allOf"].add(s.doc_);
+        for (auto& s : schemas) link(Slot::ALL_OF, nullptr, s);
         return *this;
     }
 
-    // Build to JsonDocument
-    JsonDocument build() { return std::move(doc_); }
+    // Build to JsonDocument, on the heap whatever the store used.
+    JsonDocument build() const;
+
+private:
+    struct Node;
+    struct Store;
+
+    // Where a linked child goes in its parent.
+    enum class Slot : uint8_t {
+        NONE,
+        PROPERTIES,
+        ITEMS,
+        ONE_OF,
+        ANY_OF,
+        ALL_OF,
+    };
+
+    // This node's own keywords, creating the node on first use; null if that fails.
+    JsonVariant keywords();
+    // Lets go of the node and the store.
+    void reset();
+    /* Attaches `child` under `slot`. It is linked as is when it is in this
+     * schema's store; the callers only ever pass a Schema nothing else refers
+     * to (a by-value parameter, or an initializer_list element). */
+    Schema& link(Slot slot, const char* name, const Schema& child);
+
+    Store* store_ = nullptr;
+    uint32_t node_ = 0;
+};
+
+// Writes c as it appears inside a JSON string into out; returns the length.
+constexpr size_t escapeJsonChar(unsigned char c, char (&out)[6]) {
+    const char* escape = c == '"' ? "\\\"" : c == '\\' ? "\\\\" : c == '\b' ? "\\b" : c == '\f' ? "\\f"
+                       : c == '\n' ? "\\n" : c == '\r' ? "\\r" : c == '\t' ? "\\t" : nullptr;
+    if (escape) {
+        out[0] = escape[0];
+        out[1] = escape[1];
+        return 2;
+    }
+    if (c < 0x20) {
+        const char* hex = "0123456789abcdef";
+        const char prefix[] = "\\u00";
+        for (size_t i = 0; i < 4; ++i) {
+            out[i] = prefix[i];
+        }
+        out[4] = hex[c >> 4];
+        out[5] = hex[c & 0xf];
+        return 6;
+    }
+    out[0] = static_cast<char>(c);
+    return 1;
+}
+
+template <size_t N>
+class SchemaLiteral {
+public:
+    constexpr const char* c_str() const { return text_; }
+    constexpr size_t size() const { return length_; }
+
+    // The builder's primitives; each assumes the capacity was reserved.
+    constexpr void append(char c) { text_[length_++] = c; }
+    constexpr void append(const char* text, size_t length) {
+        for (size_t i = 0; i < length; ++i) {
+            append(text[i]);
+        }
+    }
+    template <size_t M>
+    constexpr void append(const SchemaLiteral<M>& other) {
+        append(other.c_str(), other.size());
+    }
+    constexpr void append(const char* text) {
+        while (*text) {
+            append(*text++);
+        }
+    }
+
+    // As a JSON string, escaped the way ArduinoJson escapes one. At most
+    // 6 * length + 2 characters.
+    constexpr void appendQuoted(const char* text, size_t length) {
+        append('"');
+        for (size_t i = 0; i < length; ++i) {
+            char escaped[6] = {};
+            append(escaped, escapeJsonChar(static_cast<unsigned char>(text[i]), escaped));
+        }
+        append('"');
+    }
+
+    // At most 20 characters.
+    constexpr void appendInteger(long long value) {
+        unsigned long long magnitude =
+            value < 0 ? 0ULL - static_cast<unsigned long long>(value) : static_cast<unsigned long long>(value);
+        char digits[20] = {};
+        size_t count = 0;
+        do {
+            digits[count++] = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude);
+        if (value < 0) {
+            append('-');
+        }
+        while (count) {
+            append(digits[--count]);
+        }
+    }
+
+    // `"key":`, after a comma unless it is the first member.
+    constexpr void appendKey(const char* key) {
+        if (length_ > 0) {
+            append(',');
+        }
+        append('"');
+        while (*key) {
+            append(*key++);
+        }
+        append("\":", 2);
+    }
+
+private:
+    char text_[N + 1] = {};
+    size_t length_ = 0;
+};
+
+class StaticSchema;
+
+// One node of a StaticSchema: its keywords and, for an object, its properties.
+template <size_t K, size_t P>
+class StaticSchemaNode {
+public:
+    // Room for a key: the longest, additionalProperties, with comma, quotes and colon.
+    static constexpr size_t kKeyRoom = 24;
+    // What render() needs: both parts, braces, and "properties" itself.
+    static constexpr size_t kCapacity = K + P + kKeyRoom + 4;
+
+    // Common modifiers
+    template <size_t N>
+    constexpr auto description(const char (&text)[N]) const { return withString("description", text); }
+    template <size_t N>
+    constexpr auto title(const char (&text)[N]) const { return withString("title", text); }
+    template <size_t N>
+    constexpr auto format(const char (&text)[N]) const { return withString("format", text); }
+
+    // Default value
+    template <size_t N>
+    constexpr auto defaultValue(const char (&text)[N]) const { return withString("default", text); }
+    constexpr auto defaultValue(bool value) const { return withLiteral<5>("default", value ? "true" : "false"); }
+    template <typename T, typename = std::enable_if_t<std::is_integral<T>::value>>
+    constexpr auto defaultValue(T value) const { return withInteger("default", value); }
+
+    // Object modifiers
+    template <size_t N, size_t CK, size_t CP>
+    constexpr auto property(const char (&name)[N], const StaticSchemaNode<CK, CP>& child) const {
+        auto out = grown<K, P + 6 * (N - 1) + 4 + StaticSchemaNode<CK, CP>::kCapacity>();
+        if (out.properties_.size() > 0) {
+            out.properties_.append(',');
+        }
+        out.properties_.appendQuoted(name, N - 1);
+        out.properties_.append(':');
+        out.properties_.append(child.render());
+        return out;
+    }
+    template <size_t... N>
+    constexpr auto required(const char (&... names)[N]) const {
+        auto out = grown<K + kKeyRoom + 2 + (0 + ... + (6 * (N - 1) + 3)), P>();
+        out.keywords_.appendKey("required");
+        out.keywords_.append('[');
+        (out.appendListItem(names, N - 1), ...);
+        out.keywords_.append(']');
+        return out;
+    }
+    constexpr auto additionalProperties(bool value) const {
+        return withLiteral<5>("additionalProperties", value ? "true" : "false");
+    }
+
+    // Array modifiers
+    template <size_t CK, size_t CP>
+    constexpr auto items(const StaticSchemaNode<CK, CP>& child) const {
+        auto out = grown<K + kKeyRoom + StaticSchemaNode<CK, CP>::kCapacity, P>();
+        out.keywords_.appendKey("items");
+        out.keywords_.append(child.render());
+        return out;
+    }
+    constexpr auto minItems(long long n) const { return withInteger("minItems", n); }
+    constexpr auto maxItems(long long n) const { return withInteger("maxItems", n); }
+
+    // Number/integer modifiers
+    constexpr auto minimum(long long v) const { return withInteger("minimum", v); }
+    constexpr auto maximum(long long v) const { return withInteger("maximum", v); }
+    constexpr auto exclusiveMinimum(long long v) const { return withInteger("exclusiveMinimum", v); }
+    constexpr auto exclusiveMaximum(long long v) const { return withInteger("exclusiveMaximum", v); }
+    constexpr auto multipleOf(long long v) const { return withInteger("multipleOf", v); }
+
+    // String modifiers
+    constexpr auto minLength(long long n) const { return withInteger("minLength", n); }
+    constexpr auto maxLength(long long n) const { return withInteger("maxLength", n); }
+    template <size_t N>
+    constexpr auto pattern(const char (&text)[N]) const { return withString("pattern", text); }
+
+    // Enum
+    template <size_t... N>
+    constexpr auto enumValues(const char (&... values)[N]) const {
+        auto out = grown<K + kKeyRoom + 2 + (0 + ... + (6 * (N - 1) + 3)), P>();
+        out.keywords_.appendKey("enum");
+        out.keywords_.append('[');
+        (out.appendListItem(values, N - 1), ...);
+        out.keywords_.append(']');
+        return out;
+    }
+    // Enum for integer values
+    template <typename... T, typename = std::enable_if_t<(std::is_integral<T>::value && ...)>>
+    constexpr auto enumValues(T... values) const {
+        auto out = grown<K + kKeyRoom + 2 + 21 * sizeof...(T), P>();
+        out.keywords_.appendKey("enum");
+        out.keywords_.append('[');
+        (out.appendListItem(static_cast<long long>(values)), ...);
+        out.keywords_.append(']');
+        return out;
+    }
+
+    // Composition
+    template <size_t... CK, size_t... CP>
+    constexpr auto oneOf(const StaticSchemaNode<CK, CP>&... schemas) const { return withList("oneOf", schemas...); }
+    template <size_t... CK, size_t... CP>
+    constexpr auto anyOf(const StaticSchemaNode<CK, CP>&... schemas) const { return withList("anyOf", schemas...); }
+    template <size_t... CK, size_t... CP>
+    constexpr auto allOf(const StaticSchemaNode<CK, CP>&... schemas) const { return withList("allOf", schemas...); }
+
+    constexpr SchemaLiteral<kCapacity> render() const {
+        SchemaLiteral<kCapacity> out;
+        out.append('{');
+        out.append(keywords_);
+        if (object_ || properties_.size() > 0) {
+            out.append(keywords_.size() > 0 ? ",\"properties\":{" : "\"properties\":{", keywords_.size() > 0 ? 15 : 14);
+            out.append(properties_);
+            out.append('}');
+        }
+        out.append('}');
+        return out;
+    }
 
 private:
-    JsonDocument doc_;
+    template <size_t, size_t>
+    friend class StaticSchemaNode;
+    friend class StaticSchema;
+
+    // A copy with room for more.
+    template <size_t K2, size_t P2>
+    constexpr StaticSchemaNode<K2, P2> grown() const {
+        StaticSchemaNode<K2, P2> out;
+        out.keywords_.append(keywords_);
+        out.properties_.append(properties_);
+        out.object_ = object_;
+        return out;
+    }
+
+    template <size_t N>
+    constexpr auto withString(const char* key, const char (&text)[N]) const {
+        auto out = grown<K + kKeyRoom + 6 * (N - 1) + 2, P>();
+        out.keywords_.appendKey(key);
+        out.keywords_.appendQuoted(text, N - 1);
+        return out;
+    }
+    template <size_t L>
+    constexpr auto withLiteral(const char* key, const char* text) const {
+        auto out = grown<K + kKeyRoom + L, P>();
+        out.keywords_.appendKey(key);
+        while (*text) {
+            out.keywords_.append(*text++);
+        }
+        return out;
+    }
+    constexpr auto withInteger(const char* key, long long value) const {
+        auto out = grown<K + kKeyRoom + 20, P>();
+        out.keywords_.appendKey(key);
+        out.keywords_.appendInteger(value);
+        return out;
+    }
+    template <size_t... CK, size_t... CP>
+    constexpr auto withList(const char* key, const StaticSchemaNode<CK, CP>&... schemas) const {
+        auto out = grown<K + kKeyRoom + 2 + (0 + ... + (StaticSchemaNode<CK, CP>::kCapacity + 1)), P>();
+        out.keywords_.appendKey(key);
+        out.keywords_.append('[');
+        (out.appendListItem(schemas.render()), ...);
+        out.keywords_.append(']');
+        return out;
+    }
+
+    // One element of the array being written at the end of keywords_.
+    constexpr void appendListItem(const char* text, size_t length) {
+        appendComma();
+        keywords_.appendQuoted(text, length);
+    }
+    constexpr void appendListItem(long long value) {
+        appendComma();
+        keywords_.appendInteger(value);
+    }
+    template <size_t N>
+    constexpr void appendListItem(const SchemaLiteral<N>& schema) {
+        appendComma();
+        keywords_.append(schema);
+    }
+    constexpr void appendComma() {
+        if (keywords_.c_str()[keywords_.size() - 1] != '[') {
+            keywords_.append(',');
+        }
+    }
+
+    SchemaLiteral<K> keywords_;
+    SchemaLiteral<P> properties_;
+    bool object_ = false;
+};
+
+/* Compile-time counterpart of Schema, for schemas that are known in full when
+ * the firmware is built. The serialized JSON is a constant expression, so it
+ * is placed in flash and costs neither RAM nor work at boot:
+ *
+ *   static constexpr auto kEchoInput = schemaLiteral([] {
+ *       return StaticSchema::object()
+ *           .property("text", StaticSchema::string().description("Text to echo back"))
+ *           .required("text");
+ *   });
+ *   echoTool.staticInputSchema = kEchoInput.c_str();
+ *
+ * It mirrors Schema, except where sizes have to be known at compile time:
+ * required() and enumValues() take all their values in one call, numeric
+ * keywords take integers, and properties are written after the other
+ * keywords. */
+class StaticSchema {
+    // Ahead of its callers, which deduce their return type from it.
+    template <size_t N>
+    static constexpr auto typed(const char (&type)[N], bool object = false) {
+        StaticSchemaNode<StaticSchemaNode<0, 0>::kKeyRoom + N + 1, 0> out;
+        out.keywords_.appendKey("type");
+        out.keywords_.appendQuoted(type, N - 1);
+        out.object_ = object;
+        return out;
+    }
+
+public:
+    static constexpr auto object()  { return typed("object", true); }
+    static constexpr auto string()  { return typed("string"); }
+    static constexpr auto integer() { return typed("integer"); }
+    static constexpr auto number()  { return typed("number"); }
+    static constexpr auto boolean() { return typed("boolean"); }
+    static constexpr auto array()   { return typed("array"); }
+    static constexpr auto null()    { return typed("null"); }
 };
 
+/* Renders what `build` returns into a literal exactly as long as its text.
+ * `build` is a captureless lambda, so the draft, which reserves room for the
+ * worst case, exists only while compiling. */
+template <typename Build>
+constexpr auto schemaLiteral(Build build) {
+    constexpr auto draft = build().render();
+    SchemaLiteral<draft.size()> exact;
+    exact.append(draft);
+    return exact;
+}
+
+class ToolResultWriter;
+
 class ToolHandler {
 public:
     virtual ~ToolHandler() = default;
+    // `params` is the handler's own, on the heap; it may be kept past the call.
     virtual JsonDocument call(JsonDocument params) = 0;
 
     /* Error-reporting variant; this is what the dispatcher invokes. The default
@@ -255,6 +980,120 @@ public:
         isError = false;
         return call(std::move(params));
     }
+
+    // Non-null for a handler the dispatcher should drive in place instead.
+    virtual ToolResultWriter* resultWriter() { return nullptr; }
+};
+
+/* Handler variant that builds its result in place. The dispatcher hands it the
+ * arguments as a read-only view into the parsed request, valid only for the
+ * call, and an empty object that already is the reply's structuredContent:
+ * nothing is returned by value, and nothing is copied into the reply
+ * afterwards. The result is
+ * always an object; setting isError sends it as text content only, exactly as
+ * for a by-value handler.
+ *
+ * The by-value overloads are implemented on top of the writer, so code that
+ * invokes a handler directly, through ToolHandler, keeps working. */
+class ToolResultWriter : public ToolHandler {
+public:
+    virtual void call(JsonVariantConst arguments, JsonObject result, bool& isError) = 0;
+
+    JsonDocument call(JsonDocument params) override {
+        bool ignored;
+        return call(std::move(params), ignored);
+    }
+    JsonDocument call(JsonDocument params, bool& isError) override {
+        JsonDocument result;
+        isError = false;
+        call(params.as<JsonVariantConst>(), result.to<JsonObject>(), isError);
+        return result;
+    }
+
+    ToolResultWriter* resultWriter() override { return this; }
+};
+
+/* A handler held by value rather than behind a shared_ptr: a function pointer
+ * with a context pointer, or a small callable stored inline. It builds the
+ * result in place, as ToolResultWriter::call does. The dispatcher copies it
+ * out of the registry, which allocates nothing and touches no reference
+ * count, so it must be copyable and fit in kInlineSize; anything bigger, or
+ * with state that must outlive a re-registration, belongs in a ToolHandler. */
+class ToolFunction {
+public:
+    using Call = void (*)(void* context, JsonVariantConst arguments, JsonObject result, bool& isError);
+    static constexpr size_t kInlineSize = 4 * sizeof(void*);
+
+    ToolFunction() = default;
+
+    ToolFunction(Call call, void* context)
+        : ToolFunction([call, context](JsonVariantConst arguments, JsonObject result, bool& isError) {
+              call(context, arguments, result, isError);
+          }) {}
+
+    // Whether a callable of type F can be held: copyable, and small enough to store inline.
+    template <typename F>
+    static constexpr bool fits = sizeof(F) <= kInlineSize && alignof(F) <= alignof(std::max_align_t) &&
+                                 std::is_copy_constructible<F>::value;
+
+    // Any callable taking (arguments, result, isError) that fits; anything else does not convert.
+    template <typename F,
+              typename = std::enable_if_t<!std::is_same<std::decay_t<F>, ToolFunction>::value &&
+                                          std::is_invocable<F&, JsonVariantConst, JsonObject, bool&>::value &&
+                                          fits<F>>>
+    ToolFunction(F fn) {
+        static const Ops ops = {
+            [](void* self, JsonVariantConst arguments, JsonObject result, bool& isError) {
+                (*static_cast<F*>(self))(arguments, result, isError);
+            },
+            [](void* to, const void* from) { new (to) F(*static_cast<const F*>(from)); },
+            [](void* self) { static_cast<F*>(self)->~F(); },
+        };
+        new (storage_) F(std::move(fn));
+        ops_ = &ops;
+    }
+
+    ToolFunction(const ToolFunction& other) : ops_(other.ops_) {
+        if (ops_) {
+            ops_->copy(storage_, other.storage_);
+        }
+    }
+
+    ToolFunction& operator=(const ToolFunction& other) {
+        if (this != &other) {
+            reset();
+            if (other.ops_) {
+                other.ops_->copy(storage_, other.storage_);
+            }
+            ops_ = other.ops_;
+        }
+        return *this;
+    }
+
+    ~ToolFunction() { reset(); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    void operator()(JsonVariantConst arguments, JsonObject result, bool& isError) {
+        ops_->invoke(storage_, arguments, result, isError);
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void* self, JsonVariantConst arguments, JsonObject result, bool& isError);
+        void (*copy)(void* to, const void* from);
+        void (*destroy)(void* self);
+    };
+
+    void reset() {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+    const Ops* ops_ = nullptr;
 };
 
 // Tool definition
@@ -264,11 +1103,449 @@ public:
 
     String name;
     String description;
+    /* Literals used instead of name and description when set. Referenced where
+     * they are, never copied, so they must have static storage. */
+    const char* staticName = nullptr;
+    const char* staticDescription = nullptr;
     JsonDocument inputSchema;
     JsonDocument outputSchema;
+    /* Schemas from schemaLiteral(), used instead of the documents above when
+     * set. Referenced where they are, never copied, so they must have static
+     * storage. */
+    const char* staticInputSchema = nullptr;
+    const char* staticOutputSchema = nullptr;
     std::shared_ptr<ToolHandler> handler;
+    // Used instead of handler when set.
+    ToolFunction function;
+    /* Builds the handler on the first tools/call instead of before
+     * registration, for handlers that hold large buffers or a peripheral.
+     * Used when neither handler nor function is set; it runs on the worker
+     * task, and at most once however many calls arrive together. Without a
+     * worker (see begin()) it runs on async_tcp like the call itself, and
+     * idleTimeoutMs is not enforced. */
+    std::function<std::shared_ptr<ToolHandler>()> factory;
+    /* With a factory, drop the handler again once it has gone this long
+     * without a call; the next call builds a new one. 0 keeps it for good. */
+    uint32_t idleTimeoutMs = 0;
 };
 
+/* Serialized JSON, such as a schema or the tools/list body: a copy of its
+ * own, or a static literal referenced in place. Either way NUL-terminated. */
+class JsonText {
+public:
+    JsonText() = default;
+    explicit JsonText(const char* literal) : literal_(literal), length_(std::strlen(literal)) {}
+    JsonText(const char* literal, size_t length) : literal_(literal), length_(length) {}
+    explicit JsonText(PlacedString text) : owned_(std::move(text)) {}
+
+    const char* data() const { return literal_ ? literal_ : owned_.data(); }
+    const char* c_str() const { return data(); }
+    size_t size() const { return literal_ ? length_ : owned_.size(); }
+    bool empty() const { return size() == 0; }
+    // False for a referenced literal.
+    bool owned() const { return !literal_; }
+
+private:
+    PlacedString owned_;
+    const char* literal_ = nullptr;
+    size_t length_ = 0;
+};
+
+/* A tool's name or description: a static literal referenced in place, or a
+ * copy of its own. The copy is an allocation of its own rather than a string
+ * with inline storage, so its address survives moves and the registry can key
+ * on a view of it. */
+class ToolString {
+public:
+    ToolString() = default;
+
+    static ToolString literal(const char* text) {
+        ToolString out;
+        out.text_ = text;
+        out.length_ = std::strlen(text);
+        return out;
+    }
+    static ToolString copy(const char* text, size_t length);
+
+    const char* c_str() const { return text_; }
+    size_t size() const { return length_; }
+    std::string_view view() const { return {text_, length_}; }
+
+private:
+    struct Free {
+        void operator()(char* ptr) const { free(ptr); }
+    };
+    std::unique_ptr<char, Free> owned_;
+    const char* text_ = "";
+    size_t length_ = 0;
+};
+
+class LazyToolHandler;
+
+/* What the server keeps of a registered Tool. The schemas are only ever
+ * spliced into tools/list, so they are kept as the JSON text that goes there
+ * rather than as trees; anything that needs a tree parses one on demand. */
+struct RegisteredTool {
+    ToolString name;  // what the registry is keyed by
+    ToolString description;
+    JsonText inputSchema;
+    JsonText outputSchema;  // empty when the tool declares none
+    /* The tool's object in the tools/list array, serialized by the first
+     * tools/list after registration and copied as is by every one after. Once
+     * it exists, schemas the tool owned are views into it. */
+    JsonText listEntry;
+    std::shared_ptr<ToolHandler> handler;
+    ToolFunction function;  // when set, handler is null
+    std::shared_ptr<LazyToolHandler> lazy;  // when set, handler and function are null
+};
+
+/* A tool defined entirely at compile time, for firmware whose tool set is
+ * fixed. Everything it refers to has static storage, so a table of them can be
+ * constexpr and stay in flash. `call` builds the result in place, as
+ * ToolResultWriter::call does, so dispatching one allocates nothing. */
+struct StaticTool {
+    const char* name;
+    const char* description;
+    const char* inputSchema;   // from schemaLiteral()
+    const char* outputSchema;  // may be null
+    void (*call)(JsonVariantConst arguments, JsonObject result, bool& isError);
+};
+
+// A StaticTool table with its tools/list result, rendered while compiling.
+template <size_t Count, size_t Length>
+struct StaticToolTable {
+    const StaticTool* tools;
+    SchemaLiteral<Length> toolsList;
+};
+
+constexpr size_t jsonTextLength(const char* text) {
+    size_t length = 0;
+    while (text[length]) {
+        ++length;
+    }
+    return length;
+}
+
+// Length of `text` as a JSON string, quotes included.
+constexpr size_t jsonQuotedLength(const char* text) {
+    size_t length = 2;
+    for (; *text; ++text) {
+        char escaped[6] = {};
+        length += escapeJsonChar(static_cast<unsigned char>(*text), escaped);
+    }
+    return length;
+}
+
+constexpr const char* kStaticToolsListOpen = "{\"tools\":[";
+constexpr const char* kStaticToolsListClose = "]}";
+
+// The tools/list result for `tools`, written to `out` or, when null, only measured.
+template <size_t N>
+constexpr size_t writeStaticToolsList(const StaticTool* tools, size_t count, SchemaLiteral<N>* out) {
+    size_t length = 0;
+    auto text = [&](const char* piece) {
+        length += jsonTextLength(piece);
+        if (out) {
+            out->append(piece);
+        }
+    };
+    auto quoted = [&](const char* piece) {
+        length += jsonQuotedLength(piece);
+        if (out) {
+            out->appendQuoted(piece, jsonTextLength(piece));
+        }
+    };
+    text(kStaticToolsListOpen);
+    for (size_t i = 0; i < count; ++i) {
+        text(i ? ",{\"name\":" : "{\"name\":");
+        quoted(tools[i].name);
+        text(",\"description\":");
+        quoted(tools[i].description);
+        text(",\"inputSchema\":");
+        text(tools[i].inputSchema ? tools[i].inputSchema : "null");
+        if (tools[i].outputSchema) {
+            text(",\"outputSchema\":");
+            text(tools[i].outputSchema);
+        }
+        text("}");
+    }
+    text(kStaticToolsListClose);
+    return length;
+}
+
+/* Builds a StaticToolTable from `table`, a captureless lambda returning a
+ * reference to a constexpr StaticTool array:
+ *
+ *   static constexpr StaticTool kTools[] = {
+ *       {"echo", "Echo back the input text", kEchoInput.c_str(), nullptr, echo},
+ *   };
+ *   static constexpr auto kToolTable = toolTable([]() -> const auto& { return kTools; });
+ *   mcpServer->RegisterTools(kToolTable);
+ */
+template <typename Table>
+constexpr auto toolTable(Table table) {
+    constexpr size_t count = std::extent<std::remove_reference_t<decltype(table())>>::value;
+    constexpr size_t length = writeStaticToolsList<0>(table(), count, nullptr);
+    StaticToolTable<count, length> out{table(), {}};
+    writeStaticToolsList(table(), count, &out.toolsList);
+    return out;
+}
+
+/* One member of a struct a typed tool takes or returns. A struct lists its
+ * members in a static constexpr fields() returning a tuple of these:
+ *
+ *   struct AddArgs {
+ *       int a = 0;
+ *       int b = 0;
+ *       static constexpr auto fields() {
+ *           return std::make_tuple(toolField("a", &AddArgs::a, "First addend"),
+ *                                  optionalToolField("b", &AddArgs::b));
+ *       }
+ *   };
+ */
+template <typename Struct, typename Member>
+struct ToolField {
+    const char* name;
+    Member Struct::*member;
+    const char* description;  // may be null
+    bool required;
+};
+
+template <typename Struct, typename Member>
+constexpr ToolField<Struct, Member> toolField(const char* name, Member Struct::*member,
+                                              const char* description = nullptr) {
+    return {name, member, description, true};
+}
+
+// A member the client may leave out; it then keeps its default.
+template <typename Struct, typename Member>
+constexpr ToolField<Struct, Member> optionalToolField(const char* name, Member Struct::*member,
+                                                      const char* description = nullptr) {
+    return {name, member, description, false};
+}
+
+/* How a typed tool's values map to JSON: the schema they publish, and decoding
+ * from and encoding to a variant. Provided for bool, integers, floating point,
+ * std::string, String, std::vector of any of these, and structs with fields().
+ * decode() returns false for a value of the wrong type. */
+template <typename T, typename = void>
+struct ToolValue {
+    static constexpr auto kFields = T::fields();
+    static constexpr size_t kCount = std::tuple_size<decltype(kFields)>::value;
+    static_assert(kCount <= 32, "a typed tool struct has at most 32 fields");
+
+    static Schema schema() {
+        Schema out = Schema::object();
+        std::apply([&](const auto&... field) { (addProperty(out, field), ...); }, kFields);
+        return out;
+    }
+
+    /* One pass over the object, each member matched against the fields by
+     * name; then any required field it did not carry fails the decode. */
+    static bool decode(JsonVariantConst in, T& out) {
+        if (!in.isNull() && !in.is<JsonObjectConst>()) {
+            return false;
+        }
+        uint32_t seen = 0;
+        bool decoded = true;
+        for (JsonPairConst member : in.as<JsonObjectConst>()) {
+            decodeMember(member, out, seen, decoded, std::make_index_sequence<kCount>());
+        }
+        return decoded && (requiredMask(std::make_index_sequence<kCount>()) & ~seen) == 0;
+    }
+
+    static void encode(const T& in, JsonVariant out) {
+        encodeMembers(in, out.to<JsonObject>());
+    }
+
+    static void encodeMembers(const T& in, JsonObject out) {
+        std::apply(
+            [&](const auto&... field) {
+                (encodeMember(in.*field.member, out[field.name].template to<JsonVariant>()), ...);
+            },
+            kFields);
+    }
+
+private:
+    template <typename Member>
+    static void encodeMember(const Member& in, JsonVariant out) {
+        ToolValue<Member>::encode(in, out);
+    }
+
+    template <typename Field>
+    static void addProperty(Schema& out, const Field& field) {
+        Schema property = ToolValue<std::decay_t<decltype(std::declval<T&>().*field.member)>>::schema();
+        if (field.description) {
+            property.description(field.description);
+        }
+        out.property(field.name, property);
+        if (field.required) {
+            out.required({field.name});
+        }
+    }
+
+    template <size_t... I>
+    static void decodeMember(JsonPairConst member, T& out, uint32_t& seen, bool& decoded,
+                             std::index_sequence<I...>) {
+        const char* key = member.key().c_str();
+        ((std::strcmp(key, std::get<I>(kFields).name) == 0
+              ? (seen |= 1u << I,
+                 decoded = ToolValue<std::decay_t<decltype(out.*std::get<I>(kFields).member)>>::decode(
+                               member.value(), out.*std::get<I>(kFields).member) &&
+                           decoded)
+              : false),
+         ...);
+    }
+
+    template <size_t... I>
+    static constexpr uint32_t requiredMask(std::index_sequence<I...>) {
+        return ((std::get<I>(kFields).required ? 1u << I : 0u) | ... | 0u);
+    }
+};
+
+template <>
+struct ToolValue<bool> {
+    static Schema schema() { return Schema::boolean(); }
+    static bool decode(JsonVariantConst in, bool& out) {
+        out = in.as<bool>();
+        return in.is<bool>();
+    }
+    static void encode(bool in, JsonVariant out) { out.set(in); }
+};
+
+template <typename T>
+struct ToolValue<T, std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, bool>::value>> {
+    static Schema schema() {
+        Schema out = Schema::integer();
+        if (std::is_unsigned<T>::value) {
+            out.minimum(0);
+        }
+        return out;
+    }
+    /* False too for a value outside T's range. A whole number written with a
+     * fraction, such as 3.0, is parsed as a float, for which is<T>() is false;
+     * it is an integer to JSON Schema and to the validator, so it is taken. */
+    static bool decode(JsonVariantConst in, T& out) {
+        out = in.as<T>();
+        if (in.is<T>()) {
+            return true;
+        }
+        if (!in.is<double>()) {
+            return false;
+        }
+        const double value = in.as<double>();
+        // max() + 1 is a power of two, so exact where max() may not be.
+        if (std::trunc(value) != value || value < static_cast<double>(std::numeric_limits<T>::min()) ||
+            value >= static_cast<double>(std::numeric_limits<T>::max()) + 1.0) {
+            return false;
+        }
+        out = static_cast<T>(value);
+        return true;
+    }
+    static void encode(T in, JsonVariant out) { out.set(in); }
+};
+
+template <typename T>
+struct ToolValue<T, std::enable_if_t<std::is_floating_point<T>::value>> {
+    static Schema schema() { return Schema::number(); }
+    static bool decode(JsonVariantConst in, T& out) {
+        out = in.as<T>();
+        return in.is<T>();
+    }
+    static void encode(T in, JsonVariant out) { out.set(in); }
+};
+
+template <>
+struct ToolValue<std::string> {
+    static Schema schema() { return Schema::string(); }
+    static bool decode(JsonVariantConst in, std::string& out) {
+        const char* text = in.as<const char*>();
+        if (!text) {
+            return false;
+        }
+        out.assign(text, in.as<JsonString>().size());
+        return true;
+    }
+    static void encode(const std::string& in, JsonVariant out) { out.set(in); }
+};
+
+template <>
+struct ToolValue<String> {
+    static Schema schema() { return Schema::string(); }
+    static bool decode(JsonVariantConst in, String& out) {
+        out = in.as<String>();
+        return in.is<const char*>();
+    }
+    static void encode(const String& in, JsonVariant out) { out.set(in); }
+};
+
+template <typename T>
+struct ToolValue<std::vector<T>> {
+    static Schema schema() { return Schema::array().items(ToolValue<T>::schema()); }
+    static bool decode(JsonVariantConst in, std::vector<T>& out) {
+        JsonArrayConst items = in.as<JsonArrayConst>();
+        if (items.isNull()) {
+            return false;
+        }
+        out.clear();
+        out.reserve(items.size());
+        for (JsonVariantConst item : items) {
+            out.emplace_back();
+            if (!ToolValue<T>::decode(item, out.back())) {
+                return false;
+            }
+        }
+        return true;
+    }
+    static void encode(const std::vector<T>& in, JsonVariant out) {
+        JsonArray items = out.to<JsonArray>();
+        for (const T& item : in) {
+            ToolValue<T>::encode(item, items.add<JsonVariant>());
+        }
+    }
+};
+
+/* What RegisterTool<Args, Result>() runs: arguments are decoded
+ * straight from the request's tree into Args, and Result is encoded straight
+ * into the reply's structuredContent. `fn` takes `const Args&`, and
+ * optionally a `bool& isError`, and returns Result. */
+template <typename Args, typename Result, typename F>
+void callTypedTool(F& fn, JsonVariantConst arguments, JsonObject result, bool& isError) {
+    Args args{};
+    if (!ToolValue<Args>::decode(arguments, args)) {
+        /* Arguments the validator checks are rejected before the call; this
+         * catches what it does not cover, such as an integer too large for
+         * its member. */
+        isError = true;
+        result["error"] = "arguments do not match the inputSchema";
+        return;
+    }
+    if constexpr (std::is_invocable<F&, const Args&, bool&>::value) {
+        ToolValue<Result>::encodeMembers(fn(args, isError), result);
+    } else {
+        ToolValue<Result>::encodeMembers(fn(args), result);
+    }
+}
+
+// The same for an `fn` too big for a ToolFunction.
+template <typename Args, typename Result, typename F>
+class TypedToolHandler final : public ToolResultWriter {
+public:
+    explicit TypedToolHandler(F fn) : fn_(std::move(fn)) {}
+
+    using ToolResultWriter::call;
+
+    void call(JsonVariantConst arguments, JsonObject result, bool& isError) override {
+        callTypedTool<Args, Result>(fn_, arguments, result, isError);
+    }
+
+private:
+    F fn_;
+};
+
+class ArgumentValidator;
+class SlabPool;
+
 class MCPServer {
 public:
     MCPServer(uint16_t port, const String& name = DEFAULT_SERVER_NAME,
@@ -276,11 +1553,48 @@ public:
               const String& instructions = "");
     ~MCPServer();
 
+    /* The schemas are serialized here, once; later changes to the Tool's
+     * documents have no effect on the registered tool. */
     void RegisterTool(const Tool& tool);
-    // Overload for callers that can give up ownership: skips the deep copy of
-    // the schema documents. Equivalent in every other respect.
+    // Overload for callers that can give up ownership: moves the handler,
+    // function and factory instead of copying them. The name and description
+    // are copied either way. Equivalent in every other respect.
     void RegisterTool(Tool&& tool);
 
+    /* Adds a compile-time tool table. Its tools are listed after the
+     * registered ones, and while there are no others its tools/list text is
+     * served as is. Names must not clash with registered tools. One table is
+     * in use at a time; a later call replaces it. */
+    template <size_t Count, size_t Length>
+    void RegisterTools(const StaticToolTable<Count, Length>& table) {
+        registerToolTable(table.tools, Count, JsonText(table.toolsList.c_str(), table.toolsList.size()));
+    }
+
+    /* Registers `fn` as a tool over plain structs (see ToolField): both
+     * schemas are derived from Args' and Result's fields, and neither the
+     * arguments nor the result pass through a document of their own. `name`
+     * and `description` are referenced in place, as staticName is.
+     *
+     *   mcpServer->RegisterTool<AddArgs, AddResult>("add", "Adds two integers",
+     *       [](const AddArgs& args) { return AddResult{args.a + args.b}; });
+     */
+    template <typename Args, typename Result, typename F>
+    void RegisterTool(const char* name, const char* description, F fn) {
+        Tool tool;
+        tool.staticName = name;
+        tool.staticDescription = description;
+        tool.inputSchema = ToolValue<Args>::schema().build();
+        tool.outputSchema = ToolValue<Result>::schema().build();
+        if constexpr (ToolFunction::fits<F>) {
+            tool.function = [fn](JsonVariantConst arguments, JsonObject result, bool& isError) mutable {
+                callTypedTool<Args, Result>(fn, arguments, result, isError);
+            };
+        } else {
+            tool.handler = std::make_shared<TypedToolHandler<Args, Result, F>>(std::move(fn));
+        }
+        RegisterTool(std::move(tool));
+    }
+
     /* Starts the HTTP listener. Register all tools first: doing so afterwards
      * would race the request handlers against mutations of the tool registry.
      * Call only once WiFi is connected — setupMDNS() reads WiFi.localIP() to
@@ -295,8 +1609,8 @@ private:
     void setupMDNS();
     void handleEndpointRequest(AsyncWebServerRequest* request);
     void handlePostComplete(AsyncWebServerRequest* request);
-    void handleJsonBody(AsyncWebServerRequest* request, const char* body);
-    void deferToolCall(AsyncWebServerRequest* request, MCPRequest&& mcpRequest);
+    void handleJsonBody(AsyncWebServerRequest* request, const char* body, size_t length);
+    void deferToolCall(AsyncWebServerRequest* request, MCPRequest&& mcpRequest, MCPArena::Ref arena);
     void sendJSONRPCError(AsyncWebServerRequest* request, int httpCode, ErrorCode rpcCode, const char* message);
     void sendMCPResponse(AsyncWebServerRequest* request, const MCPResponse& response);
     bool validateProtocolVersionHeader(AsyncWebServerRequest* request);
@@ -312,10 +1626,17 @@ private:
      * can subclass and drive it without going through the HTTP transport. */
 protected:
     MCPRequest parseRequest(const char* json);
+    MCPRequest parseRequest(const char* json, size_t length);
     MCPRequest parseRequest(const std::string& json);
+    /* parseRequest in two steps. scanRequest validates the JSON-RPC envelope
+     * in one allocation-free pass over the text and fills in everything but
+     * doc; materializeRequest then builds doc from the recorded span, which
+     * must still be alive. Callers that can reject on the envelope alone do so
+     * between the two and never pay for the tree. */
+    MCPRequest scanRequest(const char* json, size_t length);
+    void materializeRequest(MCPRequest& request);
     std::string serializeResponse(const MCPResponse& response);
-    MCPResponse createJSONRPCError(int httpCode, int rpcCode, const JsonVariantConst& id,
-                                   const std::string& message);
+    MCPResponse createJSONRPCError(int httpCode, int rpcCode, const MCPId& id, const std::string& message);
     MCPResponse handle(MCPRequest& request);
     MCPResponse handleInitialize(MCPRequest& request);
     MCPResponse handlePing(MCPRequest& request);
@@ -328,15 +1649,53 @@ protected:
      * Capabilities advertise listChanged:false, so between registrations this
      * is a constant — and clients ask for it on every session start. Guarded by
      * toolsMutex along with the registry itself, since tools/list is served on
-     * async_tcp while tools/call runs on the worker task. */
-    const std::string& toolsListJson();
-
-    /* Keyed on std::string rather than Arduino String so a lookup key built
-     * from the request costs no heap: short-string optimization keeps tool
-     * names of ~15 characters entirely on the stack, whereas String always
-     * allocates. */
-    std::map<std::string, Tool> tools;
-    std::string toolsListCache;
+     * async_tcp while tools/call runs on the worker task. A rebuild replaces
+     * the buffer rather than rewriting it, so a reference taken under the lock
+     * stays valid, and unchanged, after it is released. */
+    std::shared_ptr<const JsonText> toolsListJson();
+    /* The tools/list result for one page of MCP_TOOLS_LIST_PAGE_SIZE tools
+     * from `offset`, with a nextCursor unless it is the last. Built per
+     * request, from the same cached entries as the whole list. */
+    std::shared_ptr<const JsonText> toolsListPage(size_t offset);
+    // Serializes the entries of tools registered since the last call.
+    void cacheToolEntries();
+    // A registered tool's inputSchema, parsed from its stored text; null for an unknown name.
+    JsonDocument inputSchemaOf(const std::string& name);
+    void addTool(RegisteredTool&& registered, const Tool& tool);
+    void registerToolTable(const StaticTool* table, size_t count, JsonText toolsList);
+    // INVARIANT: callers must hold toolsMutex.
+    const StaticTool* findStaticTool(const char* name) const;
+    void setArgumentFilter(std::string_view name, std::shared_ptr<const JsonDocument> filter);
+    void setArgumentValidator(std::string_view name, std::shared_ptr<const ArgumentValidator> validator);
+    /* Checks a tools/call's arguments against its tool's compiled inputSchema
+     * while they are still the scanned text, so before materializeRequest().
+     * False, with the reason in `problem`, only for arguments the schema
+     * rejects; a tool without a validator, or an unknown one, passes. The
+     * transport calls it to reject a call before queueing it; otherwise
+     * materializeRequest() does, and handleFunctionCalls() answers with the
+     * problem it recorded. */
+    bool checkArguments(MCPRequest& request, std::string& problem);
+    /* Drops lazily built handlers idle past their timeout. Run by the worker
+     * task every MCP_IDLE_SWEEP_MS once such a tool is registered; a handler
+     * still in use by a call is kept. */
+    void evictIdleHandlers();
+
+    /* Keyed on a view of each entry's own name, so neither registering nor
+     * looking up a tool copies it: a literal name is never copied at all, and
+     * a lookup reads the request's name where it is. */
+    std::map<std::string_view, RegisteredTool, std::less<>> tools;
+    /* Per-tool parse filters compiled from inputSchema at registration; a
+     * tool whose schema admits undeclared members has no entry. Shared so a
+     * parse can hold one without holding toolsMutex. Keyed on the same views
+     * as tools, or on a table's static names. */
+    std::map<std::string_view, std::shared_ptr<const JsonDocument>, std::less<>> argumentFilters;
+    // The same for validators, kept only for schemas that constrain something.
+    std::map<std::string_view, std::shared_ptr<const ArgumentValidator>, std::less<>> argumentValidators;
+    std::shared_ptr<const JsonText> toolsListCache;
+    // The RegisterTools() table, if any, and its own tools/list text.
+    const StaticTool* staticTools = nullptr;
+    size_t staticToolCount = 0;
+    JsonText staticToolsList;
     bool toolsListDirty = true;
     std::mutex toolsMutex;
 
@@ -356,6 +1715,15 @@ protected:
     TaskHandle_t worker_handle = nullptr;
     SemaphoreHandle_t worker_done = nullptr;
     std::atomic<bool> worker_exit{false};
+    /* Set once a lazy tool with an idleTimeoutMs is registered. Until then the
+     * worker has nothing to sweep and blocks on job_queue indefinitely. */
+    std::atomic<bool> idle_sweep{false};
+
+    /* Reserved by begin() for request bodies and deferred jobs, so steady
+     * traffic does not come and go on the general heap. Null when the
+     * reservation failed; both allocations then use the heap as before. */
+    SlabPool* bodyPool = nullptr;
+    SlabPool* jobPool = nullptr;
 };
 
 #endif  // MCP_SERVER_H
@@ -4,14 +4,25 @@
 #include <ArduinoJson.h>
 #include <ESPmDNS.h>
 #include <WiFi.h>
+#include <esp_heap_caps.h>
 #include <esp_system.h>
 
+#include <algorithm>
 #include <cctype>
+#include <cmath>
+#include <cstddef>
 #include <cstdlib>
 #include <cstring>
 #include <functional>
 #include <new>
 #include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 const char* const PROTOCOL_VERSION = "2025-11-25";
 const char* const PROTOCOL_VERSION_2025_06_18 = "2025-06-18";
@@ -19,18 +30,142 @@ const char* const PROTOCOL_VERSION_2025_03_26 = "2025-03-26";
 const char* const DEFAULT_SERVER_NAME = "ESP32-MCP-Server";
 const char* const DEFAULT_SERVER_VERSION = "1.0.0";
 
+// ---------------------------------------------------------------------------
+// Memory placement
+// ---------------------------------------------------------------------------
+
+namespace {
+
+bool belongsInPsram(size_t size) {
+    return MCP_PSRAM_THRESHOLD > 0 && size > MCP_PSRAM_THRESHOLD;
+}
+
+/* A large buffer tries PSRAM first; on a board without it the capability
+ * allocator just returns null. A small one asks for internal RAM by name,
+ * because a PSRAM build may serve plain malloc() from PSRAM. Either heap
+ * frees with free(). */
+void* placedMalloc(size_t size, bool large) {
+    if (large) {
+        void* ptr = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (ptr) {
+            return ptr;
+        }
+    }
+    void* ptr = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    return ptr ? ptr : malloc(size);
+}
+
+// A block that grows past the threshold moves out to PSRAM.
+void* placedRealloc(void* ptr, size_t size) {
+    if (belongsInPsram(size)) {
+        void* moved = heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (moved) {
+            return moved;
+        }
+    }
+    return realloc(ptr, size);
+}
+
+}  // namespace
+
+void* mcpPlacedAlloc(size_t size) {
+    return placedMalloc(size, belongsInPsram(size));
+}
+
+// ---------------------------------------------------------------------------
+// Slab pools
+// ---------------------------------------------------------------------------
+
+/* Equal slots carved from one malloc() block, reserved once. take() and give()
+ * are O(1) and lock-free, since slots are taken on async_tcp and given back on
+ * either task: a set bit in free_ marks a free slot. Every slot handed out
+ * holds a reference on the pool, so a reply or an aborted upload that outlives
+ * the server can still return its slot. */
+class SlabPool {
+public:
+    static constexpr size_t kMaxSlots = 32;
+
+    /* Null when the block cannot be allocated or `slots` is 0. Placed by slot
+     * size, so a pool of many small hot objects stays internal. */
+    static SlabPool* create(size_t slotSize, size_t slots) {
+        slots = std::min(slots, kMaxSlots);
+        if (slots == 0) {
+            return nullptr;
+        }
+        const bool large = belongsInPsram(slotSize);
+        slotSize = round(slotSize);
+        void* block = placedMalloc(round(sizeof(SlabPool)) + slotSize * slots, large);
+        if (!block) {
+            return nullptr;
+        }
+        return new (block) SlabPool(slotSize, slots);
+    }
+
+    static void release(SlabPool* pool) {
+        if (pool && pool->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            pool->~SlabPool();
+            free(pool);
+        }
+    }
+
+    // Null when every slot is in use.
+    void* take() {
+        uint32_t bits = free_.load(std::memory_order_acquire);
+        while (bits != 0) {
+            const uint32_t lowest = bits & (~bits + 1);
+            if (free_.compare_exchange_weak(bits, bits & ~lowest, std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+                refs_.fetch_add(1, std::memory_order_relaxed);
+                return base() + static_cast<size_t>(__builtin_ctz(lowest)) * slotSize_;
+            }
+        }
+        return nullptr;
+    }
+
+    void give(void* slot) {
+        const size_t index = static_cast<size_t>(static_cast<unsigned char*>(slot) - base()) / slotSize_;
+        free_.fetch_or(uint32_t(1) << index, std::memory_order_release);
+        release(this);
+    }
+
+private:
+    SlabPool(size_t slotSize, size_t slots)
+        : slotSize_(slotSize), free_(slots == kMaxSlots ? ~uint32_t(0) : (uint32_t(1) << slots) - 1), refs_(1) {}
+
+    static constexpr size_t round(size_t size) {
+        return (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+    }
+
+    unsigned char* base() { return reinterpret_cast<unsigned char*>(this) + round(sizeof(SlabPool)); }
+
+    size_t slotSize_;
+    std::atomic<uint32_t> free_;
+    std::atomic<int> refs_;
+};
+
 namespace {
 
 /* Accumulated POST body, stored in request->_tempObject. ESPAsyncWebServer
  * releases _tempObject with free() when a request dies (including aborted
  * uploads), so this must be one malloc() block with no destructor — anything
- * else either leaks or corrupts the heap on disconnect. */
+ * else either leaks or corrupts the heap on disconnect. A buffer from the body
+ * pool is not a malloc() block; the request's onDisconnect callback, which
+ * runs before that free(), gives it back and clears _tempObject. */
 struct BodyBuffer {
+    SlabPool* pool;  // null for a malloc() block
     size_t received;
     uint8_t status;
     char data[1];  // over-allocated to hold the body plus a NUL terminator
 };
 
+void releaseBody(BodyBuffer* body) {
+    if (body && body->pool) {
+        body->pool->give(body);
+    } else {
+        free(body);
+    }
+}
+
 enum : uint8_t {
     BODY_OK = 0,
     BODY_TOO_LARGE = 1,
@@ -54,22 +189,510 @@ bool isJsonContentType(const String& value) {
     return *cursor == '\0' || *cursor == ';';
 }
 
+/* ---------------------------------------------------------------------------
+ * JSON string escaping
+ *
+ * Text content is a serialized result escaped once more, and tool results are
+ * often kilobytes of logs, CSV or base64 in which almost nothing needs
+ * escaping. The scan below skips clean bytes a word at a time — four on the
+ * ESP32, eight or sixteen on a host — and clean runs are copied in bulk.
+ * ------------------------------------------------------------------------- */
+
+/* How each byte is escaped inside a string: 0 for as-is, 'u' for \u00XX,
+ * otherwise the letter after the backslash. These are ArduinoJson 7's rules,
+ * so the output is byte-for-byte what its serializer writes: the two
+ * characters JSON reserves, the five control characters with a short form,
+ * and NUL. Other control characters go out as they are. Built at compile
+ * time, so it costs no startup work and sits in flash. */
+struct EscapeTable {
+    char kind[256];
+};
+
+constexpr EscapeTable makeEscapeTable() {
+    EscapeTable table{};
+    table.kind[static_cast<uint8_t>('"')] = '"';
+    table.kind[static_cast<uint8_t>('\\')] = '\\';
+    table.kind[static_cast<uint8_t>('\b')] = 'b';
+    table.kind[static_cast<uint8_t>('\f')] = 'f';
+    table.kind[static_cast<uint8_t>('\n')] = 'n';
+    table.kind[static_cast<uint8_t>('\r')] = 'r';
+    table.kind[static_cast<uint8_t>('\t')] = 't';
+    table.kind[0] = 'u';
+    return table;
+}
+
+constexpr EscapeTable kEscapes = makeEscapeTable();
+
+// Writes the escaped form of c into out (at least 6 bytes); returns its length.
+size_t escapeByte(uint8_t c, char* out) {
+    char kind = kEscapes.kind[c];
+    if (kind == 0) {
+        out[0] = static_cast<char>(c);
+        return 1;
+    }
+    out[0] = '\\';
+    if (kind != 'u') {
+        out[1] = kind;
+        return 2;
+    }
+    const char* hex = "0123456789abcdef";
+    out[1] = 'u';
+    out[2] = '0';
+    out[3] = '0';
+    out[4] = hex[c >> 4];
+    out[5] = hex[c & 0x0F];
+    return 6;
+}
+
+/* Length of the leading run of s that needs no escaping: no quote, no
+ * backslash, no control character. A run may stop early at a control
+ * character ArduinoJson leaves alone; escapeByte copies that through. */
+size_t cleanRun(const uint8_t* s, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                   _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask != 0) {
+            return i + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8(s + i);
+        uint8x16_t hit = vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\\'))),
+                                  vcleq_u8(v, vdupq_n_u8(0x1F)));
+        if (vmaxvq_u8(hit) != 0) {
+            break;  // the loops below pin it down
+        }
+    }
+#endif
+    /* SWAR: a byte below 0x20, or equal to '"' or '\\' once XORed to zero,
+     * borrows into its own high bit. That says whether a word holds a stop
+     * byte, not exactly where, so the byte loop finds it. Words are read
+     * aligned: the Xtensa core faults on a misaligned 32-bit load. */
+    using Word = uintptr_t;
+    const Word ones = ~Word(0) / 0xFF;
+    const Word highs = ones * 0x80;
+    while (i < n && (reinterpret_cast<uintptr_t>(s + i) & (sizeof(Word) - 1)) != 0) {
+        if (s[i] == '"' || s[i] == '\\' || s[i] < 0x20) {
+            return i;
+        }
+        ++i;
+    }
+    for (; i + sizeof(Word) <= n; i += sizeof(Word)) {
+        Word w;
+        memcpy(&w, __builtin_assume_aligned(s + i, sizeof(Word)), sizeof(Word));
+        Word q = w ^ (ones * '"');
+        Word b = w ^ (ones * '\\');
+        if ((((w - ones * 0x20) & ~w) | ((q - ones) & ~q) | ((b - ones) & ~b)) & highs) {
+            break;
+        }
+    }
+    for (; i < n; ++i) {
+        if (s[i] == '"' || s[i] == '\\' || s[i] < 0x20) {
+            break;
+        }
+    }
+    return i;
+}
+
+// s as the inside of a JSON string literal, exactly as ArduinoJson writes it.
+template <typename Sink>
+void writeEscaped(Sink& sink, const uint8_t* s, size_t n) {
+    while (n > 0) {
+        size_t run = cleanRun(s, n);
+        if (run > 0) {
+            sink.write(s, run);
+            s += run;
+            n -= run;
+        }
+        if (n > 0) {
+            char escaped[6];
+            size_t len = escapeByte(*s++, escaped);
+            sink.write(reinterpret_cast<const uint8_t*>(escaped), len);
+            --n;
+        }
+    }
+}
+
+/* Serializes a reply a buffer at a time, straight from its MCPResponse.
+ *
+ * A deferred tools/call used to be serialized into a std::string on the
+ * worker, so until the last chunk left, the device held the result tree and
+ * its full text at once — for a text-content reply, twice over. This walks
+ * the tree instead, with an explicit stack so it can stop wherever the TCP
+ * buffer fills and pick up there on the next filler call. The bytes are
+ * writeResponse's exactly. When the caller's buffer is nearly full, steps
+ * write into a small carry buffer instead, so an escape sequence is never
+ * split by hand.
+ *
+ * Frames point into the response, which must stay put and unmodified for as
+ * long as the stream is read. */
+class ResponseStream {
+public:
+    ResponseStream() = default;
+    ResponseStream(const ResponseStream&) = delete;
+    ResponseStream& operator=(const ResponseStream&) = delete;
+
+    void reset(const MCPResponse& response) {
+        stack_.clear();
+        carryLength_ = carryOffset_ = 0;
+        inText_ = false;
+
+        // Queued in writing order, then flipped so the first step is on top.
+        pushLiteral("{\"jsonrpc\":\"2.0\",\"id\":");
+        pushId(response.id());
+        if (response.kind() == MCPResponse::Kind::RAW) {
+            pushLiteral(",\"result\":");
+            pushLiteral(response.raw()->data(), response.raw()->size());
+        } else if (response.kind() == MCPResponse::Kind::RESULT &&
+                   response.textSource != MCPResponse::TextSource::NONE) {
+            const bool structured = response.textSource == MCPResponse::TextSource::STRUCTURED;
+            JsonObjectConst result = response.document().as<JsonObjectConst>();
+            pushLiteral(",\"result\":{\"content\":[{\"type\":\"text\",\"text\":\"");
+            push(Frame(Step::TEXT_BEGIN));
+            pushValue(structured ? result["structuredContent"] : response.document().as<JsonVariantConst>());
+            push(Frame(Step::TEXT_END));
+            pushLiteral("\"}]");
+            if (structured) {
+                for (JsonPairConst member : result) {
+                    pushLiteral(",");
+                    pushString(member.key().c_str(), member.key().size());
+                    pushLiteral(":");
+                    pushValue(member.value());
+                }
+            } else {
+                pushLiteral(response.toolError ? ",\"isError\":true" : ",\"isError\":false");
+            }
+            pushLiteral("}");
+        } else if (response.kind() == MCPResponse::Kind::RESULT) {
+            pushLiteral(",\"result\":");
+            pushValue(response.document().as<JsonVariantConst>());
+        } else if (response.kind() == MCPResponse::Kind::ERROR) {
+            pushLiteral(",\"error\":");
+            pushValue(response.document().as<JsonVariantConst>());
+        }
+        pushLiteral("}");
+        std::reverse(stack_.begin(), stack_.end());
+    }
+
+    // Copies out up to maxLen bytes; 0 once the reply is complete.
+    size_t read(uint8_t* buffer, size_t maxLen) {
+        size_t written = 0;
+        while (written < maxLen) {
+            if (carryOffset_ < carryLength_) {
+                size_t n = carryLength_ - carryOffset_;
+                if (n > maxLen - written) {
+                    n = maxLen - written;
+                }
+                memcpy(buffer + written, carry_ + carryOffset_, n);
+                carryOffset_ += n;
+                written += n;
+                continue;
+            }
+            size_t produced;
+            if (maxLen - written >= sizeof(carry_)) {
+                produced = produce(reinterpret_cast<char*>(buffer) + written, maxLen - written);
+                written += produced;
+            } else {
+                carryOffset_ = 0;
+                carryLength_ = produced = produce(carry_, sizeof(carry_));
+            }
+            if (produced == 0) {
+                break;
+            }
+        }
+        return written;
+    }
+
+    // Length of the whole reply, found by streaming it once into scratch.
+    static size_t measure(const MCPResponse& response) {
+        ResponseStream counter;
+        counter.reset(response);
+        uint8_t scratch[128];
+        size_t total = 0;
+        for (size_t n; (n = counter.read(scratch, sizeof(scratch))) > 0;) {
+            total += n;
+        }
+        return total;
+    }
+
+private:
+    enum class Step : uint8_t { LITERAL, STRING, VALUE, OBJECT, ARRAY, TEXT_BEGIN, TEXT_END };
+
+    struct Frame {
+        explicit Frame(Step step) : step(step) {}
+
+        Step step;
+        bool started = false;  // STRING: opening quote out; OBJECT/ARRAY: first member out
+        const char* data = nullptr;
+        size_t size = 0;
+        size_t offset = 0;
+        JsonVariantConst value;
+        JsonObjectConst::iterator member, memberEnd;
+        JsonArrayConst::iterator element, elementEnd;
+    };
+
+    static constexpr size_t kMaxScalar = 32;  // longest number or literal serialized in place
+    static constexpr size_t kMaxEscaped = 8;  // \u00XX, escaped once more
+
+    void push(Frame frame) { stack_.push_back(frame); }
+
+    void pushLiteral(const char* text, size_t size) {
+        Frame frame(Step::LITERAL);
+        frame.data = text;
+        frame.size = size;
+        push(frame);
+    }
+
+    void pushLiteral(const char* text) { pushLiteral(text, std::strlen(text)); }
+
+    void pushString(const char* text, size_t size) {
+        Frame frame(Step::STRING);
+        frame.data = text;
+        frame.size = size;
+        push(frame);
+    }
+
+    void pushId(const MCPId& id) {
+        if (id.kind() == MCPId::Kind::STRING) {
+            pushString(id.text(), id.length());
+        } else if (id.kind() == MCPId::Kind::NUMBER) {
+            pushLiteral(id.text(), id.length());
+        } else {
+            pushLiteral("null");
+        }
+    }
+
+    void pushValue(JsonVariantConst value) {
+        Frame frame(Step::VALUE);
+        frame.value = value;
+        push(frame);
+    }
+
+    bool hasRoom() const { return out_ + kMaxEscaped <= end_; }
+
+    // One output byte; inside the text content it is escaped once more.
+    void put(char c) {
+        if (inText_) {
+            out_ += escapeByte(static_cast<uint8_t>(c), out_);
+        } else {
+            *out_++ = c;
+        }
+    }
+
+    void putEscaped(char c) {
+        char escaped[6];
+        size_t n = escapeByte(static_cast<uint8_t>(c), escaped);
+        for (size_t i = 0; i < n; ++i) {
+            put(escaped[i]);
+        }
+    }
+
+    /* Copies clean runs of the frame's data in bulk — clean at both escaping
+     * levels — and what stops them byte by byte, escaped as string content
+     * when `string` is set. */
+    void copyRun(Frame& frame, bool string) {
+        while (frame.offset < frame.size && hasRoom()) {
+            size_t limit = frame.size - frame.offset;
+            if (limit > static_cast<size_t>(end_ - out_)) {
+                limit = static_cast<size_t>(end_ - out_);
+            }
+            size_t run = cleanRun(reinterpret_cast<const uint8_t*>(frame.data) + frame.offset, limit);
+            memcpy(out_, frame.data + frame.offset, run);
+            out_ += run;
+            frame.offset += run;
+            if (run < limit && hasRoom()) {
+                char c = frame.data[frame.offset++];
+                if (string) {
+                    putEscaped(c);
+                } else {
+                    put(c);
+                }
+            }
+        }
+    }
+
+    /* Runs steps until one of them emits something, writing into dst, which
+     * holds at least sizeof(carry_) bytes. Returns 0 once the stack is empty. */
+    size_t produce(char* dst, size_t capacity) {
+        out_ = dst;
+        end_ = dst + capacity;
+        while (out_ == dst && !stack_.empty()) {
+            step();
+        }
+        return static_cast<size_t>(out_ - dst);
+    }
+
+    void step() {
+        Frame& top = stack_.back();
+        switch (top.step) {
+            case Step::LITERAL:
+                copyRun(top, false);
+                if (top.offset == top.size) {
+                    stack_.pop_back();
+                }
+                return;
+
+            case Step::STRING:
+                if (!top.started) {
+                    top.started = true;
+                    put('"');
+                }
+                copyRun(top, true);
+                if (top.offset == top.size && hasRoom()) {
+                    put('"');
+                    stack_.pop_back();
+                }
+                return;
+
+            case Step::OBJECT: {
+                if (top.member == top.memberEnd) {
+                    put('}');
+                    stack_.pop_back();
+                    return;
+                }
+                if (top.started) {
+                    put(',');
+                }
+                top.started = true;
+                JsonPairConst member = *top.member;
+                ++top.member;
+                // Pushing invalidates `top`.
+                pushValue(member.value());
+                pushLiteral(":", 1);
+                pushString(member.key().c_str(), member.key().size());
+                return;
+            }
+
+            case Step::ARRAY: {
+                if (top.element == top.elementEnd) {
+                    put(']');
+                    stack_.pop_back();
+                    return;
+                }
+                if (top.started) {
+                    put(',');
+                }
+                top.started = true;
+                JsonVariantConst element = *top.element;
+                ++top.element;
+                pushValue(element);
+                return;
+            }
+
+            case Step::VALUE: {
+                JsonVariantConst value = top.value;
+                stack_.pop_back();
+                openValue(value);
+                return;
+            }
+
+            case Step::TEXT_BEGIN:
+            case Step::TEXT_END:
+                inText_ = top.step == Step::TEXT_BEGIN;
+                stack_.pop_back();
+                return;
+        }
+    }
+
+    void openValue(JsonVariantConst value) {
+        if (value.is<JsonObjectConst>()) {
+            JsonObjectConst object = value.as<JsonObjectConst>();
+            Frame frame(Step::OBJECT);
+            frame.member = object.begin();
+            frame.memberEnd = object.end();
+            put('{');
+            push(frame);
+        } else if (value.is<JsonArrayConst>()) {
+            JsonArrayConst array = value.as<JsonArrayConst>();
+            Frame frame(Step::ARRAY);
+            frame.element = array.begin();
+            frame.elementEnd = array.end();
+            put('[');
+            push(frame);
+        } else if (value.is<const char*>()) {
+            JsonString text = value.as<JsonString>();
+            pushString(text.c_str(), text.size());
+        } else if (measureJson(value) < kMaxScalar) {
+            // null, a boolean or a number.
+            pushLiteral(scalar_, serializeJson(value, scalar_, sizeof(scalar_)));
+        } else {
+            // serialized() raw JSON, whose length is the caller's business.
+            spill_.clear();
+            serializeJson(value, spill_);
+            pushLiteral(spill_.data(), spill_.size());
+        }
+    }
+
+    std::vector<Frame> stack_;
+    // Back the one scalar that can be in flight; raw JSON may be any length.
+    char scalar_[kMaxScalar];
+    std::string spill_;
+    char carry_[2 * kMaxEscaped];
+    size_t carryLength_ = 0;
+    size_t carryOffset_ = 0;
+    char* out_ = nullptr;
+    char* end_ = nullptr;
+    bool inText_ = false;
+};
+
 /* One deferred tools/call. Shared between the async_tcp task (the chunked
  * response filler) and the worker task. Reference-counted intrusively and
- * allocated with new (std::nothrow) so that running out of memory on the
+ * allocated without throwing so that running out of memory on the
  * request path is a graceful HTTP 500 in BOTH exception modes — make_shared
  * would abort the device under -fno-exceptions. One reference belongs to the
  * queue/worker hand-off, one to the response filler; whichever drops last
  * frees the job. */
 struct HttpToolJob {
+    /* From `pool` when it has a free slot, from the heap otherwise. Null only
+     * when both are exhausted. */
+    static HttpToolJob* create(SlabPool* pool, MCPArena::Ref arena) {
+        void* memory = pool ? pool->take() : nullptr;
+        if (!memory) {
+            pool = nullptr;
+            memory = ::operator new(sizeof(HttpToolJob), std::nothrow);
+            if (!memory) {
+                return nullptr;
+            }
+        }
+        auto* job = new (memory) HttpToolJob(std::move(arena));
+        job->pool = pool;
+        return job;
+    }
+
+    explicit HttpToolJob(MCPArena::Ref arena) : arena(std::move(arena)) {}
+
+    // Declared first so that it outlives the documents allocated from it.
+    MCPArena::Ref arena;
     MCPRequest request;
-    std::string response;  // serialized JSON-RPC; valid once done is set
+    /* The request body, taken over from _tempObject so it outlives the HTTP
+     * request; request.payloadJson points into it until the worker has
+     * materialized the arguments. */
+    BodyBuffer* body = nullptr;
+    MCPResponse response;   // valid once done is set
+    ResponseStream stream;  // over `response`; read only by async_tcp
     std::atomic<bool> done{false};
     std::atomic<int> refs{1};
+    SlabPool* pool = nullptr;  // null when the job lives on the heap
+
+    ~HttpToolJob() { releaseBody(body); }
 
     static void release(HttpToolJob* job) {
         if (job && job->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
-            delete job;
+            SlabPool* pool = job->pool;
+            job->~HttpToolJob();
+            if (pool) {
+                pool->give(job);
+            } else {
+                ::operator delete(job);
+            }
         }
     }
 };
@@ -112,52 +735,2019 @@ public:
     using RequestFn = std::function<void(AsyncWebServerRequest*)>;
     using BodyFn = std::function<void(AsyncWebServerRequest*, uint8_t*, size_t, size_t, size_t)>;
 
-    MCPEndpointHandler(const char* uri, RequestFn onRequest, BodyFn onBody)
-        : uri_(uri), onRequest_(std::move(onRequest)), onBody_(std::move(onBody)) {}
+    MCPEndpointHandler(const char* uri, RequestFn onRequest, BodyFn onBody)
+        : uri_(uri), onRequest_(std::move(onRequest)), onBody_(std::move(onBody)) {}
+
+    bool canHandle(AsyncWebServerRequest* request) const override {
+        return request->url() == uri_;
+    }
+
+    void handleRequest(AsyncWebServerRequest* request) override {
+        onRequest_(request);
+    }
+
+    void handleBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index,
+                    size_t total) override {
+        onBody_(request, data, len, index, total);
+    }
+
+    // A "trivial" handler never has the request body delivered to it.
+    bool isRequestHandlerTrivial() const override {
+        return false;
+    }
+
+private:
+    String uri_;
+    RequestFn onRequest_;
+    BodyFn onBody_;
+};
+
+/* Appending sink for serializeJson. ArduinoJson's std::string writer clears the
+ * destination in its constructor, so emitting several documents into one buffer
+ * needs a writer that only ever appends; the default Writer template picks this
+ * up by duck-typing on write(). */
+template <typename String>
+struct StringAppender {
+    String* out;
+
+    size_t write(uint8_t c) {
+        out->push_back(static_cast<char>(c));
+        return 1;
+    }
+
+    size_t write(const uint8_t* s, size_t n) {
+        out->append(reinterpret_cast<const char*>(s), n);
+        return n;
+    }
+};
+
+/* Writes what it is given as the inside of a JSON string literal, escaped the
+ * way ArduinoJson escapes a string value. */
+template <typename Sink>
+struct EscapingWriter {
+    Sink* sink;
+
+    size_t write(uint8_t c) {
+        writeEscaped(*sink, &c, 1);
+        return 1;
+    }
+
+    size_t write(const uint8_t* s, size_t n) {
+        writeEscaped(*sink, s, n);
+        return n;
+    }
+};
+
+template <typename Sink>
+void writeLiteral(Sink& sink, const char* text) {
+    sink.write(reinterpret_cast<const uint8_t*>(text), std::strlen(text));
+}
+
+/* A tools/call result whose text content was deferred: content first, its one
+ * text item serialized from the payload through the escaper, then whatever
+ * else resultDoc holds. */
+template <typename Sink>
+void writeDeferredTextResult(const MCPResponse& response, Sink& sink) {
+    const bool structured = response.textSource == MCPResponse::TextSource::STRUCTURED;
+    JsonObjectConst result = response.document().as<JsonObjectConst>();
+    JsonVariantConst payload = structured ? result["structuredContent"] : response.document().as<JsonVariantConst>();
+
+    EscapingWriter<Sink> escaped{&sink};
+    writeLiteral(sink, "{\"content\":[{\"type\":\"text\",\"text\":\"");
+    serializeJson(payload, escaped);
+    writeLiteral(sink, "\"}]");
+    if (!structured) {
+        writeLiteral(sink, response.toolError ? ",\"isError\":true}" : ",\"isError\":false}");
+        return;
+    }
+    for (JsonPairConst member : result) {
+        writeLiteral(sink, ",\"");
+        escaped.write(reinterpret_cast<const uint8_t*>(member.key().c_str()), member.key().size());
+        writeLiteral(sink, "\":");
+        serializeJson(member.value(), sink);
+    }
+    writeLiteral(sink, "}");
+}
+
+// A null id is written as `null`, per spec.
+template <typename Sink>
+void writeId(const MCPId& id, Sink& sink) {
+    if (id.kind() == MCPId::Kind::STRING) {
+        writeLiteral(sink, "\"");
+        writeEscaped(sink, reinterpret_cast<const uint8_t*>(id.text()), id.length());
+        writeLiteral(sink, "\"");
+    } else if (id.kind() == MCPId::Kind::NUMBER) {
+        sink.write(reinterpret_cast<const uint8_t*>(id.text()), id.length());
+    } else {
+        writeLiteral(sink, "null");
+    }
+}
+
+/* Sink that only counts: a dry run of a write sequence sizes its buffer
+ * exactly, the way measureJson does for a single document. */
+struct CountingSink {
+    size_t count = 0;
+
+    size_t write(uint8_t) {
+        ++count;
+        return 1;
+    }
+
+    size_t write(const uint8_t*, size_t n) {
+        count += n;
+        return n;
+    }
+};
+
+// The JSON-RPC envelope of a reply, written out member by member.
+template <typename Sink>
+void writeResponse(const MCPResponse& response, Sink& sink) {
+    writeLiteral(sink, "{\"jsonrpc\":\"2.0\",\"id\":");
+    writeId(response.id(), sink);
+
+    switch (response.kind()) {
+        case MCPResponse::Kind::RAW:
+            writeLiteral(sink, ",\"result\":");
+            sink.write(reinterpret_cast<const uint8_t*>(response.raw()->data()), response.raw()->size());
+            break;
+        case MCPResponse::Kind::RESULT:
+            writeLiteral(sink, ",\"result\":");
+            if (response.textSource != MCPResponse::TextSource::NONE) {
+                writeDeferredTextResult(response, sink);
+            } else {
+                serializeJson(response.document(), sink);
+            }
+            break;
+        case MCPResponse::Kind::ERROR:
+            writeLiteral(sink, ",\"error\":");
+            serializeJson(response.document(), sink);
+            break;
+        case MCPResponse::Kind::NONE:
+            break;
+    }
+    writeLiteral(sink, "}");
+}
+
+/* A dry run sizes `out` first, so it is allocated once and never regrown —
+ * and, for a placed string, lands in the right heap the first time. */
+template <typename String>
+void serializeInto(const MCPResponse& response, String& out) {
+    CountingSink measured;
+    writeResponse(response, measured);
+
+    out.reserve(measured.count);
+    StringAppender<String> sink{&out};
+    writeResponse(response, sink);
+}
+
+constexpr const char* kOutputSchemaKey = ",\"outputSchema\":";
+
+template <typename Sink>
+void writeQuoted(Sink& sink, const char* text, size_t length) {
+    writeLiteral(sink, "\"");
+    writeEscaped(sink, reinterpret_cast<const uint8_t*>(text), length);
+    writeLiteral(sink, "\"");
+}
+
+/* One tool's object in the tools/list array, with its stored schema text
+ * spliced in as is. */
+template <typename Sink>
+void writeToolEntry(std::string_view name, const RegisteredTool& tool, Sink& sink) {
+    writeLiteral(sink, "{\"name\":");
+    writeQuoted(sink, name.data(), name.size());
+    writeLiteral(sink, ",\"description\":");
+    writeQuoted(sink, tool.description.c_str(), tool.description.size());
+    writeLiteral(sink, ",\"inputSchema\":");
+    sink.write(reinterpret_cast<const uint8_t*>(tool.inputSchema.data()), tool.inputSchema.size());
+    if (!tool.outputSchema.empty()) {
+        writeLiteral(sink, kOutputSchemaKey);
+        sink.write(reinterpret_cast<const uint8_t*>(tool.outputSchema.data()), tool.outputSchema.size());
+    }
+    writeLiteral(sink, "}");
+}
+
+/* Serializes a tool's entry, once, for every later tools/list to copy as is.
+ * Schema text of the tool's own is then dropped for a view of the same bytes
+ * in the entry, so caching it costs no more than the copies it replaces. The
+ * views stay valid because a map node never moves. */
+void cacheToolEntry(std::string_view name, RegisteredTool& tool) {
+    CountingSink measured;
+    writeToolEntry(name, tool, measured);
+    PlacedString entry;
+    entry.reserve(measured.count);
+    StringAppender<PlacedString> sink{&entry};
+    writeToolEntry(name, tool, sink);
+    tool.listEntry = JsonText(std::move(entry));
+
+    // Both schemas sit at the end of the entry, just before its closing brace.
+    const char* end = tool.listEntry.data() + tool.listEntry.size() - 1;
+    if (!tool.outputSchema.empty()) {
+        const size_t length = tool.outputSchema.size();
+        if (tool.outputSchema.owned()) {
+            tool.outputSchema = JsonText(end - length, length);
+        }
+        end -= length + std::strlen(kOutputSchemaKey);
+    }
+    if (tool.inputSchema.owned()) {
+        const size_t length = tool.inputSchema.size();
+        tool.inputSchema = JsonText(end - length, length);
+    }
+}
+
+/* Length of a table tool's entry in the table's own list text, counted the
+ * way writeStaticToolsList writes it, so a page can lift it out in place. */
+size_t staticToolEntryLength(const StaticTool& tool) {
+    size_t length = std::strlen("{\"name\":") + jsonQuotedLength(tool.name) + std::strlen(",\"description\":") +
+                    jsonQuotedLength(tool.description) + std::strlen(",\"inputSchema\":") +
+                    std::strlen(tool.inputSchema ? tool.inputSchema : "null") + std::strlen("}");
+    if (tool.outputSchema) {
+        length += std::strlen(kOutputSchemaKey) + std::strlen(tool.outputSchema);
+    }
+    return length;
+}
+
+// One tools/list page from its entries' text, and the cursor of the next if there is one.
+template <typename Sink>
+void writeToolsListPage(const std::vector<std::string_view>& entries, const std::string& nextCursor, Sink& sink) {
+    writeLiteral(sink, "{\"tools\":[");
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (i) {
+            writeLiteral(sink, ",");
+        }
+        sink.write(reinterpret_cast<const uint8_t*>(entries[i].data()), entries[i].size());
+    }
+    writeLiteral(sink, "]");
+    if (!nextCursor.empty()) {
+        writeLiteral(sink, ",\"nextCursor\":");
+        writeQuoted(sink, nextCursor.data(), nextCursor.size());
+    }
+    writeLiteral(sink, "}");
+}
+
+/* The tools/list result, concatenated from each tool's cached entry. A
+ * RegisterTools() table's entries follow, lifted out of its own list text. */
+template <typename Sink>
+void writeToolsList(const std::map<std::string_view, RegisteredTool, std::less<>>& tools, const JsonText& staticList,
+                    Sink& sink) {
+    writeLiteral(sink, "{\"tools\":[");
+    bool first = true;
+    for (const auto& entry : tools) {
+        if (!first) {
+            writeLiteral(sink, ",");
+        }
+        first = false;
+        const JsonText& text = entry.second.listEntry;
+        sink.write(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+    }
+    const size_t framing = std::strlen(kStaticToolsListOpen) + std::strlen(kStaticToolsListClose);
+    if (staticList.size() > framing) {
+        if (!first) {
+            writeLiteral(sink, ",");
+        }
+        sink.write(reinterpret_cast<const uint8_t*>(staticList.data() + std::strlen(kStaticToolsListOpen)),
+                   staticList.size() - framing);
+    }
+    writeLiteral(sink, "]}");
+}
+
+/* Length-delimited response that sends a body it owns. beginResponse takes the
+ * body as a String — one more full copy of every reply; this takes the
+ * serialized string by move and copies it only into the TCP buffer. */
+class OwnedBodyResponse : public AsyncAbstractResponse {
+public:
+    OwnedBodyResponse(int code, PlacedString body) : body_(std::move(body)) {
+        setCode(code);
+        setContentType("application/json");
+        setContentLength(body_.size());
+    }
+
+    bool _sourceValid() const override {
+        return true;
+    }
+
+    size_t _fillBuffer(uint8_t* buf, size_t maxLen) override {
+        size_t n = body_.size() - sent_;
+        if (n > maxLen) {
+            n = maxLen;
+        }
+        memcpy(buf, body_.data() + sent_, n);
+        sent_ += n;
+        return n;
+    }
+
+private:
+    PlacedString body_;
+    size_t sent_ = 0;
+};
+
+/* Length-delimited reply of a deferred tools/call that finished within the
+ * fast-path window, read straight out of the job's stream. */
+class StreamedJobResponse : public AsyncAbstractResponse {
+public:
+    explicit StreamedJobResponse(JobRef job) : job_(std::move(job)) {
+        setCode(200);
+        setContentType("application/json");
+        setContentLength(ResponseStream::measure(job_->response));
+    }
+
+    bool _sourceValid() const override {
+        return true;
+    }
+
+    size_t _fillBuffer(uint8_t* buf, size_t maxLen) override {
+        return job_->stream.read(buf, maxLen);
+    }
+
+private:
+    JobRef job_;
+};
+
+/* Length-delimited reply whose result is a shared buffer, such as the
+ * tools/list cache. Only the envelope around it is written per request; the
+ * result goes from the buffer straight into the TCP buffer, never copied
+ * whole, and the reference keeps it alive until the last byte is sent. */
+class SharedResultResponse : public AsyncAbstractResponse {
+public:
+    SharedResultResponse(int code, PlacedString prefix, std::shared_ptr<const JsonText> result)
+        : prefix_(std::move(prefix)), result_(std::move(result)) {
+        setCode(code);
+        setContentType("application/json");
+        setContentLength(prefix_.size() + result_->size() + 1);
+    }
+
+    bool _sourceValid() const override {
+        return true;
+    }
+
+    size_t _fillBuffer(uint8_t* buf, size_t maxLen) override {
+        const std::string_view parts[] = {{prefix_.data(), prefix_.size()},
+                                          {result_->data(), result_->size()},
+                                          {"}", 1}};
+        size_t skip = sent_;
+        size_t written = 0;
+        for (std::string_view part : parts) {
+            if (skip >= part.size()) {
+                skip -= part.size();
+                continue;
+            }
+            const size_t n = std::min(part.size() - skip, maxLen - written);
+            memcpy(buf + written, part.data() + skip, n);
+            written += n;
+            skip = 0;
+            if (written == maxLen) {
+                break;
+            }
+        }
+        sent_ += written;
+        return written;
+    }
+
+private:
+    PlacedString prefix_;  // the envelope up to and including "result":
+    std::shared_ptr<const JsonText> result_;
+    size_t sent_ = 0;
+};
+
+void sendOwnedBody(AsyncWebServerRequest* request, int code, PlacedString body) {
+    auto* response = new (std::nothrow) OwnedBodyResponse(code, std::move(body));
+    if (!response) {
+        request->send(500);
+        return;
+    }
+    response->addHeader("MCP-Protocol-Version", PROTOCOL_VERSION);
+    request->send(response);
+}
+
+void sendSharedResult(AsyncWebServerRequest* request, const MCPResponse& reply) {
+    PlacedString prefix;
+    StringAppender<PlacedString> sink{&prefix};
+    writeLiteral(sink, "{\"jsonrpc\":\"2.0\",\"id\":");
+    writeId(reply.id(), sink);
+    writeLiteral(sink, ",\"result\":");
+
+    auto* response = new (std::nothrow) SharedResultResponse(reply.code, std::move(prefix), reply.raw());
+    if (!response) {
+        request->send(500);
+        return;
+    }
+    response->addHeader("MCP-Protocol-Version", PROTOCOL_VERSION);
+    request->send(response);
+}
+
+/* ---------------------------------------------------------------------------
+ * JSON-RPC envelope scanner
+ *
+ * A request body used to be deserialized whole before anything looked at its
+ * method, so a malformed request, an unknown method or a bad
+ * MCP-Protocol-Version header each paid for a full tree build first. The
+ * scanner walks the raw text once instead, validating its syntax and recording
+ * where each envelope member sits; nothing is allocated. Only once the
+ * envelope has been accepted is the part of params a handler actually reads
+ * handed to ArduinoJson.
+ *
+ * Syntax is RFC 8259 with the nesting limit ArduinoJson applies, so anything
+ * the scanner accepts also deserializes. Like deserializeJson, bytes after the
+ * first complete value are ignored.
+ * ------------------------------------------------------------------------- */
+
+// Raw text of one JSON value inside the request body, [begin, end).
+struct JsonSpan {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+
+    bool isSet() const { return begin != nullptr; }
+    size_t size() const { return static_cast<size_t>(end - begin); }
+    bool isObject() const { return isSet() && *begin == '{'; }
+    bool isArray() const { return isSet() && *begin == '['; }
+    bool isString() const { return isSet() && *begin == '"'; }
+    bool isNull() const { return isSet() && *begin == 'n'; }
+    bool isNumber() const { return isSet() && (*begin == '-' || (*begin >= '0' && *begin <= '9')); }
+};
+
+class JsonScanner {
+public:
+    JsonScanner(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+    // First significant character, or '\0' at the end of the input.
+    char peek() {
+        skipWhitespace();
+        return p_ == end_ ? '\0' : *p_;
+    }
+
+    /* Skips one complete value, validating it, and reports its extent. At most
+     * `nestingLimit` containers may be open at once. Iterative rather than
+     * recursive: this runs on async_tcp, whose stack is not ours to spend. */
+    bool scanValue(JsonSpan& span, uint8_t nestingLimit) {
+        uint32_t objectBits = 0;  // one bit per open container: set for an object
+        uint8_t depth = 0;
+        skipWhitespace();
+        span.begin = p_;
+        for (;;) {
+            skipWhitespace();
+            if (p_ == end_) {
+                return fail();
+            }
+            const char c = *p_;
+            if (c == '{' || c == '[') {
+                if (depth >= nestingLimit || depth >= 32) {
+                    return fail();
+                }
+                const char close = c == '{' ? '}' : ']';
+                objectBits = (objectBits << 1) | (c == '{' ? 1u : 0u);
+                ++depth;
+                ++p_;
+                skipWhitespace();
+                if (p_ == end_ || *p_ != close) {
+                    if (c == '{' && !scanKey()) {
+                        return fail();
+                    }
+                    continue;  // on to the first element
+                }
+                ++p_;
+                --depth;
+                objectBits >>= 1;
+            } else if (c == '"') {
+                if (!skipString()) {
+                    return fail();
+                }
+            } else if (c == '-' || (c >= '0' && c <= '9')) {
+                if (!skipNumber()) {
+                    return fail();
+                }
+            } else if (!(skipLiteral("true") || skipLiteral("false") || skipLiteral("null"))) {
+                return fail();
+            }
+
+            // A value just ended: close what is finished, or step to the next element.
+            for (;;) {
+                if (depth == 0) {
+                    span.end = p_;
+                    return true;
+                }
+                skipWhitespace();
+                if (p_ == end_) {
+                    return fail();
+                }
+                const bool inObject = (objectBits & 1u) != 0;
+                if (*p_ == ',') {
+                    ++p_;
+                    if (inObject && !scanKey()) {
+                        return fail();
+                    }
+                    break;
+                }
+                if (*p_ != (inObject ? '}' : ']')) {
+                    return fail();
+                }
+                ++p_;
+                --depth;
+                objectBits >>= 1;
+            }
+        }
+    }
+
+    /* Walks the members of one object without descending: enterObject()
+     * consumes the opening brace, then each nextMember() reads a key and its
+     * colon, leaving the value for scanValue(). nextMember() returns false at
+     * the closing brace and on a syntax error; failed() tells the two apart.
+     * A walk that descends into members keeps its own `first` per level. */
+    bool enterObject() {
+        if (peek() != '{') {
+            return fail();
+        }
+        ++p_;
+        firstMember_ = true;
+        return true;
+    }
+
+    bool nextMember(JsonSpan& key) {
+        return nextMember(key, firstMember_);
+    }
+
+    bool nextMember(JsonSpan& key, bool& first) {
+        if (!nextItem('}', first)) {
+            return false;
+        }
+        key.begin = p_;
+        if (*p_ != '"' || !skipString()) {
+            return fail();
+        }
+        key.end = p_;
+        skipWhitespace();
+        if (p_ == end_ || *p_ != ':') {
+            return fail();
+        }
+        ++p_;
+        return true;
+    }
+
+    // The same for the elements of an array, leaving each for scanValue().
+    bool enterArray() {
+        if (peek() != '[') {
+            return fail();
+        }
+        ++p_;
+        return true;
+    }
+
+    bool nextElement(bool& first) {
+        return nextItem(']', first);
+    }
+
+    bool failed() const { return failed_; }
+
+private:
+    // Steps past the comma before an item; false at `close` or at the end.
+    bool nextItem(char close, bool& first) {
+        skipWhitespace();
+        if (p_ == end_) {
+            return fail();
+        }
+        if (*p_ == close) {
+            ++p_;
+            return false;
+        }
+        if (!first) {
+            if (*p_ != ',') {
+                return fail();
+            }
+            ++p_;
+            skipWhitespace();
+            if (p_ == end_) {
+                return fail();
+            }
+        }
+        first = false;
+        return true;
+    }
+
+    bool fail() {
+        failed_ = true;
+        return false;
+    }
+
+    void skipWhitespace() {
+        while (p_ != end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+            ++p_;
+        }
+    }
+
+    bool scanKey() {
+        skipWhitespace();
+        if (p_ == end_ || *p_ != '"' || !skipString()) {
+            return false;
+        }
+        skipWhitespace();
+        if (p_ == end_ || *p_ != ':') {
+            return false;
+        }
+        ++p_;
+        return true;
+    }
+
+    bool skipString() {
+        ++p_;  // opening quote
+        while (p_ != end_) {
+            const char c = *p_++;
+            if (c == '"') {
+                return true;
+            }
+            if (c != '\\') {
+                continue;
+            }
+            if (p_ == end_) {
+                return false;
+            }
+            const char escape = *p_++;
+            if (escape == 'u') {
+                for (int i = 0; i < 4; ++i, ++p_) {
+                    if (p_ == end_ || !std::isxdigit(static_cast<unsigned char>(*p_))) {
+                        return false;
+                    }
+                }
+            } else if (escape == '\0' || std::strchr("\"\\/bfnrt", escape) == nullptr) {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool skipDigits() {
+        const char* start = p_;
+        while (p_ != end_ && *p_ >= '0' && *p_ <= '9') {
+            ++p_;
+        }
+        return p_ != start;
+    }
+
+    bool skipNumber() {
+        if (*p_ == '-') {
+            ++p_;
+        }
+        if (p_ == end_ || *p_ < '0' || *p_ > '9') {
+            return false;
+        }
+        if (*p_ == '0') {
+            ++p_;  // no leading zeros
+        } else {
+            skipDigits();
+        }
+        if (p_ != end_ && *p_ == '.') {
+            ++p_;
+            if (!skipDigits()) {
+                return false;
+            }
+        }
+        if (p_ != end_ && (*p_ == 'e' || *p_ == 'E')) {
+            ++p_;
+            if (p_ != end_ && (*p_ == '+' || *p_ == '-')) {
+                ++p_;
+            }
+            if (!skipDigits()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool skipLiteral(const char* literal) {
+        const size_t length = std::strlen(literal);
+        if (static_cast<size_t>(end_ - p_) < length || std::memcmp(p_, literal, length) != 0) {
+            return false;
+        }
+        p_ += length;
+        return true;
+    }
+
+    const char* p_;
+    const char* end_;
+    bool failed_ = false;
+    bool firstMember_ = true;
+};
+
+/* Fixed-capacity sink for decoding short strings (envelope keys, jsonrpc,
+ * method names) without touching the heap. Anything longer cannot match what
+ * we compare it with, so overflowing only has to be detected, not handled. */
+struct SmallStringBuffer {
+    char data[32];
+    size_t length = 0;
+    bool overflow = false;
+
+    void push_back(char c) {
+        if (length < sizeof(data)) {
+            data[length++] = c;
+        } else {
+            overflow = true;
+        }
+    }
+};
+
+template <typename Sink>
+void appendUtf8(Sink& out, uint32_t codepoint) {
+    if (codepoint < 0x80) {
+        out.push_back(static_cast<char>(codepoint));
+    } else if (codepoint < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (codepoint >> 6)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    } else if (codepoint < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (codepoint >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (codepoint >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    }
+}
+
+uint32_t readHex4(const char* p) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        const char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= static_cast<uint32_t>(c - '0');
+        } else {
+            value |= static_cast<uint32_t>((c | 0x20) - 'a' + 10);
+        }
+    }
+    return value;
+}
+
+/* Appends the contents of a string span the scanner has already validated
+ * (quotes included in the span), resolving escapes; \u sequences become UTF-8
+ * and a surrogate pair is combined into one code point. */
+template <typename Sink>
+void decodeString(const JsonSpan& span, Sink& out) {
+    const char* p = span.begin + 1;
+    const char* const end = span.end - 1;
+    while (p < end) {
+        const char c = *p++;
+        if (c != '\\') {
+            out.push_back(c);
+            continue;
+        }
+        const char escape = *p++;
+        switch (escape) {
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u': {
+                uint32_t codepoint = readHex4(p);
+                p += 4;
+                if (codepoint >= 0xD800 && codepoint <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    const uint32_t low = readHex4(p + 2);
+                    if (low >= 0xDC00 && low <= 0xDFFF) {
+                        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    }
+                }
+                appendUtf8(out, codepoint);
+                break;
+            }
+            default: out.push_back(escape); break;  // " \ /
+        }
+    }
+}
+
+bool stringEquals(const JsonSpan& span, const char* expected) {
+    if (!span.isString()) {
+        return false;
+    }
+    SmallStringBuffer decoded;
+    decodeString(span, decoded);
+    return !decoded.overflow && decoded.length == std::strlen(expected) &&
+           std::memcmp(decoded.data, expected, decoded.length) == 0;
+}
+
+// The depth deserializeJson allows by default.
+const uint8_t kNestingLimit = ARDUINOJSON_DEFAULT_NESTING_LIMIT;
+
+MCPMethod classifyMethod(const JsonSpan& method) {
+    static const struct {
+        const char* name;
+        MCPMethod method;
+    } kKnown[] = {
+        {"initialize", MCPMethod::INITIALIZE},
+        {"ping", MCPMethod::PING},
+        {"tools/list", MCPMethod::TOOLS_LIST},
+        {"tools/call", MCPMethod::TOOLS_CALL},
+        {"notifications/initialized", MCPMethod::NOTIFICATIONS_INITIALIZED},
+    };
+    for (const auto& known : kKnown) {
+        if (stringEquals(method, known.name)) {
+            return known.method;
+        }
+    }
+    return MCPMethod::OTHER;
+}
+
+// Decodes a string id into the room MCPId::reserve() made for it.
+struct IdTextSink {
+    char* out;
+    size_t length = 0;
+
+    void push_back(char c) { out[length++] = c; }
+};
+
+/* ---------------------------------------------------------------------------
+ * Argument filters
+ *
+ * deserializeJson keeps every member a client sends, and a tools/call
+ * request's arguments live as long as its job. A tool's inputSchema is
+ * compiled once, at registration, into an ArduinoJson filter: in an object
+ * closed with additionalProperties: false, undeclared members are skipped by
+ * the parser and never reach the heap. Any other object admits members it
+ * does not name, as a missing additionalProperties does in JSON Schema and in
+ * the validator below, so its value is kept whole; the same goes for
+ * patternProperties, composition, or no properties at all.
+ * ------------------------------------------------------------------------- */
+
+/* Writes into `filter` the members `schema` declares, recursing into object
+ * properties and array items. Returns false when nothing can be dropped, in
+ * which case the caller overwrites `filter` with true. */
+bool narrowFilter(JsonVariantConst schema, JsonVariant filter, uint8_t depth) {
+    if (depth == 0) {
+        return false;
+    }
+
+    JsonVariantConst items = schema["items"];
+    if (items.is<JsonObjectConst>()) {
+        // An array filter's single element applies to every element.
+        return narrowFilter(items, filter.to<JsonArray>().add<JsonVariant>(), depth - 1);
+    }
+
+    JsonObjectConst properties = schema["properties"].as<JsonObjectConst>();
+    JsonVariantConst additional = schema["additionalProperties"];
+    const bool closed = additional.is<bool>() && !additional.as<bool>();
+    if (properties.size() == 0 || !closed || !schema["patternProperties"].isNull() || !schema["oneOf"].isNull() ||
+        !schema["anyOf"].isNull() || !schema["allOf"].isNull() || !schema["$ref"].isNull()) {
+        return false;
+    }
+
+    JsonObject members = filter.to<JsonObject>();
+    for (JsonPairConst property : properties) {
+        JsonVariant member = members[property.key()];
+        if (!narrowFilter(property.value(), member, depth - 1)) {
+            member.set(true);
+        }
+    }
+    return true;
+}
+
+// Null when the schema does not let anything be dropped.
+std::shared_ptr<const JsonDocument> compileArgumentFilter(JsonVariantConst inputSchema) {
+    auto filter = std::make_shared<JsonDocument>();
+    if (!narrowFilter(inputSchema, filter->to<JsonVariant>(), kNestingLimit) || filter->overflowed()) {
+        return nullptr;
+    }
+    return filter;
+}
+
+// Sized up front, so the text is placed by its final length.
+JsonText serializeSchema(JsonVariantConst schema) {
+    PlacedString text;
+    text.reserve(measureJson(schema));
+    StringAppender<PlacedString> sink{&text};
+    serializeJson(schema, sink);
+    return JsonText(std::move(text));
+}
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// Argument validators
+// ---------------------------------------------------------------------------
+
+/* A tool's inputSchema, compiled at registration into a flat program that
+ * checks tools/call arguments while they are still the scanned request text.
+ * It runs on async_tcp before a call is queued, so a call its schema rejects
+ * costs a walk over the text and nothing else: no tree, no queue slot, no
+ * worker.
+ *
+ * Covered: type, required, enum and const, minimum and maximum (inclusive or
+ * exclusive), minLength and maxLength, minItems and maxItems, items, nested
+ * properties and additionalProperties: false. Other keywords (pattern,
+ * multipleOf, format) are not checked, and a node using composition or $ref
+ * is not checked at all, so the validator only ever rejects what the schema
+ * rejects. Nodes that check nothing compile to kAny and cost one skip. */
+class ArgumentValidator {
+public:
+    // Null when the schema constrains nothing the arguments could violate.
+    static std::shared_ptr<const ArgumentValidator> compile(JsonVariantConst inputSchema) {
+        auto validator = std::make_shared<ArgumentValidator>();
+        validator->root_ = validator->compileNode(inputSchema, kNestingLimit, true);
+        if (validator->root_ == kAny) {
+            return nullptr;
+        }
+        return validator;
+    }
+
+    /* `arguments` is an object the scanner has already vouched for. Allocates
+     * nothing unless it fails, and then only for `problem`. */
+    bool check(const JsonSpan& arguments, std::string& problem) const {
+        JsonScanner in(arguments.begin, arguments.end);
+        return checkValue(in, root_, std::string_view(), false, problem);
+    }
+
+private:
+    static constexpr uint16_t kAny = 0xFFFF;
+
+    enum Type : uint8_t {
+        NULL_VALUE = 1 << 0,
+        BOOLEAN = 1 << 1,
+        INTEGER = 1 << 2,
+        NUMBER = 1 << 3,
+        STRING = 1 << 4,
+        ARRAY = 1 << 5,
+        OBJECT = 1 << 6,
+    };
+
+    enum Flag : uint8_t {
+        MINIMUM = 1 << 0,
+        MAXIMUM = 1 << 1,
+        EXCLUSIVE_MINIMUM = 1 << 2,
+        EXCLUSIVE_MAXIMUM = 1 << 3,
+        CLOSED = 1 << 4,  // additionalProperties: false
+    };
+
+    // One schema node that checks something.
+    struct Check {
+        uint8_t types = 0;  // Type bits; 0 admits any
+        uint8_t flags = 0;
+        uint16_t items = kAny;
+        uint16_t firstProperty = 0;
+        uint16_t propertyCount = 0;
+        uint16_t firstEnum = 0;
+        uint16_t enumCount = 0;
+        uint32_t required = 0;  // bit i: properties_[firstProperty + i]
+        uint32_t minLength = 0;
+        uint32_t maxLength = UINT32_MAX;
+        uint32_t minItems = 0;
+        uint32_t maxItems = UINT32_MAX;
+        double minimum = 0;
+        double maximum = 0;
+    };
+
+    struct Property {
+        uint32_t name;  // offset into text_
+        uint16_t length;
+        uint16_t check;
+    };
+
+    struct EnumValue {
+        uint8_t type;    // NULL_VALUE, BOOLEAN, NUMBER or STRING
+        uint32_t text;   // STRING: offset into text_
+        uint16_t length;
+        double number;   // NUMBER, or BOOLEAN as 0 or 1
+    };
+
+    static uint8_t typeNamed(const char* name) {
+        static const struct {
+            const char* name;
+            uint8_t type;
+        } kTypes[] = {
+            {"null", NULL_VALUE}, {"boolean", BOOLEAN}, {"integer", INTEGER}, {"number", NUMBER},
+            {"string", STRING},   {"array", ARRAY},     {"object", OBJECT},
+        };
+        for (const auto& known : kTypes) {
+            if (name && strcmp(name, known.name) == 0) {
+                return known.type;
+            }
+        }
+        return 0xFF;  // unknown: admit anything
+    }
+
+    static uint32_t countOr(JsonVariantConst value, uint32_t fallback) {
+        return value.is<uint32_t>() ? value.as<uint32_t>() : fallback;
+    }
+
+    uint32_t keep(const char* text, size_t length) {
+        const uint32_t offset = static_cast<uint32_t>(text_.size());
+        text_.append(text, length);
+        return offset;
+    }
+
+    // Appends `value` to the enum table; false for a value it cannot compare.
+    bool addEnumValue(JsonVariantConst value) {
+        EnumValue entry{NULL_VALUE, 0, 0, 0};
+        if (value.is<const char*>()) {
+            const char* text = value.as<const char*>();
+            entry.type = STRING;
+            entry.length = static_cast<uint16_t>(strlen(text));
+            entry.text = keep(text, entry.length);
+        } else if (value.is<bool>()) {
+            entry.type = BOOLEAN;
+            entry.number = value.as<bool>() ? 1 : 0;
+        } else if (value.is<double>()) {
+            entry.type = NUMBER;
+            entry.number = value.as<double>();
+        } else if (!value.isNull()) {
+            return false;
+        }
+        enums_.push_back(entry);
+        return true;
+    }
+
+    /* Recursion is bounded by `depth`, and the tree walked is the schema, at
+     * registration; the check below recurses no deeper than what this emits. */
+    uint16_t compileNode(JsonVariantConst schema, uint8_t depth, bool root = false) {
+        JsonObjectConst keywords = schema.as<JsonObjectConst>();
+        if (depth == 0 || keywords.isNull() || !keywords["oneOf"].isNull() || !keywords["anyOf"].isNull() ||
+            !keywords["allOf"].isNull() || !keywords["not"].isNull() || !keywords["if"].isNull() ||
+            !keywords["$ref"].isNull()) {
+            return kAny;
+        }
+
+        Check check;
+        JsonVariantConst type = keywords["type"];
+        if (type.is<const char*>()) {
+            check.types = typeNamed(type.as<const char*>());
+        } else if (type.is<JsonArrayConst>()) {
+            for (JsonVariantConst name : type.as<JsonArrayConst>()) {
+                check.types |= typeNamed(name.as<const char*>());
+            }
+        }
+        if (check.types == 0xFF || (root && (check.types & OBJECT))) {
+            check.types = 0;  // arguments are always an object by the time they get here
+        }
+
+        /* Either bound may be declared both ways. Only the tighter one can
+         * reject anything, so it is the one kept: the inclusive bound when it
+         * lies strictly inside the exclusive one. */
+        if (keywords["exclusiveMinimum"].is<double>()) {
+            check.flags |= MINIMUM | EXCLUSIVE_MINIMUM;
+            check.minimum = keywords["exclusiveMinimum"].as<double>();
+        }
+        if (keywords["minimum"].is<double>() &&
+            (!(check.flags & MINIMUM) || keywords["minimum"].as<double>() > check.minimum)) {
+            check.flags = (check.flags | MINIMUM) & ~EXCLUSIVE_MINIMUM;
+            check.minimum = keywords["minimum"].as<double>();
+        }
+        if (keywords["exclusiveMaximum"].is<double>()) {
+            check.flags |= MAXIMUM | EXCLUSIVE_MAXIMUM;
+            check.maximum = keywords["exclusiveMaximum"].as<double>();
+        }
+        if (keywords["maximum"].is<double>() &&
+            (!(check.flags & MAXIMUM) || keywords["maximum"].as<double>() < check.maximum)) {
+            check.flags = (check.flags | MAXIMUM) & ~EXCLUSIVE_MAXIMUM;
+            check.maximum = keywords["maximum"].as<double>();
+        }
+        check.minLength = countOr(keywords["minLength"], 0);
+        check.maxLength = countOr(keywords["maxLength"], UINT32_MAX);
+        check.minItems = countOr(keywords["minItems"], 0);
+        check.maxItems = countOr(keywords["maxItems"], UINT32_MAX);
+
+        JsonVariantConst values = keywords["enum"];
+        const size_t enumStart = enums_.size();
+        bool enumDecidable = true;
+        if (values.is<JsonArrayConst>()) {
+            for (JsonVariantConst value : values.as<JsonArrayConst>()) {
+                enumDecidable = enumDecidable && addEnumValue(value);
+            }
+        } else if (!keywords["const"].isNull()) {
+            enumDecidable = addEnumValue(keywords["const"]);
+        }
+        if (enumDecidable) {
+            check.firstEnum = static_cast<uint16_t>(enumStart);
+            check.enumCount = static_cast<uint16_t>(enums_.size() - enumStart);
+        } else {
+            enums_.resize(enumStart);
+        }
+
+        JsonVariantConst items = keywords["items"];
+        if (items.is<JsonObjectConst>()) {
+            check.items = compileNode(items, depth - 1);
+        }
+
+        /* Properties are gathered first and appended as one block, since the
+         * properties of nested nodes are appended while this one compiles. */
+        std::vector<Property> block;
+        bool anyChecked = false;
+        for (JsonPairConst property : keywords["properties"].as<JsonObjectConst>()) {
+            const uint16_t length = static_cast<uint16_t>(strlen(property.key().c_str()));
+            const uint16_t child = compileNode(property.value(), depth - 1);
+            anyChecked = anyChecked || child != kAny;
+            block.push_back({keep(property.key().c_str(), length), length, child});
+        }
+        for (JsonVariantConst name : keywords["required"].as<JsonArrayConst>()) {
+            const char* text = name.as<const char*>();
+            if (!text) {
+                continue;
+            }
+            size_t i = 0;
+            while (i < block.size() && !(block[i].length == strlen(text) &&
+                                         memcmp(text_.data() + block[i].name, text, block[i].length) == 0)) {
+                ++i;
+            }
+            if (i == block.size()) {
+                const uint16_t length = static_cast<uint16_t>(strlen(text));
+                block.push_back({keep(text, length), length, kAny});
+            }
+            if (i < 32) {
+                check.required |= 1u << i;  // beyond 32, required goes unchecked
+            }
+        }
+        JsonVariantConst additional = keywords["additionalProperties"];
+        if (additional.is<bool>() && !additional.as<bool>() && keywords["patternProperties"].isNull()) {
+            check.flags |= CLOSED;
+        }
+        if (anyChecked || check.required || (check.flags & CLOSED)) {
+            check.firstProperty = static_cast<uint16_t>(properties_.size());
+            check.propertyCount = static_cast<uint16_t>(block.size());
+            properties_.insert(properties_.end(), block.begin(), block.end());
+        }
+
+        if (check.types == 0 && check.flags == 0 && check.enumCount == 0 && check.items == kAny &&
+            check.propertyCount == 0 && check.minLength == 0 && check.maxLength == UINT32_MAX &&
+            check.minItems == 0 && check.maxItems == UINT32_MAX) {
+            return kAny;
+        }
+        checks_.push_back(check);
+        return static_cast<uint16_t>(checks_.size() - 1);
+    }
+
+    // Counts the characters of a decoded string, not its bytes.
+    struct CharacterCounter {
+        uint32_t count = 0;
+        void push_back(char c) {
+            if ((static_cast<uint8_t>(c) & 0xC0) != 0x80) {
+                ++count;
+            }
+        }
+    };
+
+    // Compares a decoded string with `expected` as it is produced.
+    struct TextMatcher {
+        const char* expected;
+        size_t length;
+        size_t at = 0;
+        bool differs = false;
+
+        void push_back(char c) {
+            differs = differs || at >= length || expected[at] != c;
+            ++at;
+        }
+        bool matches() const { return !differs && at == length; }
+    };
+
+    static bool fail(std::string& problem, std::string_view where, bool element, const char* reason) {
+        if (where.empty()) {
+            problem = "arguments";
+        } else {
+            problem = "'";
+            problem.append(where.data(), where.size());
+            problem += element ? "' items" : "'";
+        }
+        problem += reason;
+        return false;
+    }
+
+    static bool failType(std::string& problem, std::string_view where, bool element, uint8_t types) {
+        static const char* const kNames[] = {"null", "boolean", "integer", "number", "string", "array", "object"};
+        std::string reason = " must be of type ";
+        bool first = true;
+        for (uint8_t bit = 0; bit < 7; ++bit) {
+            if (types & (1u << bit)) {
+                reason += first ? "" : " or ";
+                reason += kNames[bit];
+                first = false;
+            }
+        }
+        return fail(problem, where, element, reason.c_str());
+    }
+
+    bool matchesEnum(const Check& check, uint8_t type, const JsonSpan& value, double number) const {
+        for (uint16_t i = 0; i < check.enumCount; ++i) {
+            const EnumValue& entry = enums_[check.firstEnum + i];
+            if (entry.type == STRING && type == STRING) {
+                TextMatcher matcher{text_.data() + entry.text, entry.length};
+                decodeString(value, matcher);
+                if (matcher.matches()) {
+                    return true;
+                }
+            } else if ((entry.type == NUMBER && (type & NUMBER)) ||
+                       (entry.type == BOOLEAN && type == BOOLEAN)) {
+                if (entry.number == number) {
+                    return true;
+                }
+            } else if (entry.type == NULL_VALUE && type == NULL_VALUE) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* Recursion follows the compiled nodes only, so it is no deeper than the
+     * schema; whatever the schema leaves unchecked is skipped by scanValue. */
+    bool checkValue(JsonScanner& in, uint16_t index, std::string_view where, bool element,
+                    std::string& problem) const {
+        const Check& check = checks_[index];
+        const char c = in.peek();
+        uint8_t type = c == '{' ? OBJECT
+                     : c == '[' ? ARRAY
+                     : c == '"' ? STRING
+                     : c == 'n' ? NULL_VALUE
+                     : c == 't' || c == 'f' ? BOOLEAN
+                                              : NUMBER;
+
+        if (type == OBJECT && (check.propertyCount || (check.flags & CLOSED))) {
+            if (check.types && !(check.types & OBJECT)) {
+                return failType(problem, where, element, check.types);
+            }
+            return checkObject(in, check, problem);
+        }
+        if (type == ARRAY && (check.items != kAny || check.minItems || check.maxItems != UINT32_MAX)) {
+            if (check.types && !(check.types & ARRAY)) {
+                return failType(problem, where, element, check.types);
+            }
+            return checkArray(in, check, where, element, problem);
+        }
+
+        JsonSpan value;
+        in.scanValue(value, kNestingLimit);
+        double number = 0;
+        bool exact = true;
+        if (type == NUMBER) {
+            char digits[32];
+            exact = value.size() < sizeof(digits);
+            if (exact) {
+                memcpy(digits, value.begin, value.size());
+                digits[value.size()] = '\0';
+                number = strtod(digits, nullptr);
+            }
+            if (!exact || std::trunc(number) == number) {
+                type |= INTEGER;
+            }
+        } else if (type == BOOLEAN) {
+            number = c == 't' ? 1 : 0;
+        }
+
+        if (check.types && !(check.types & type)) {
+            return failType(problem, where, element, check.types);
+        }
+        if ((type & NUMBER) && exact) {
+            if ((check.flags & MINIMUM) &&
+                (number < check.minimum || ((check.flags & EXCLUSIVE_MINIMUM) && number == check.minimum))) {
+                return fail(problem, where, element, " is out of range");
+            }
+            if ((check.flags & MAXIMUM) &&
+                (number > check.maximum || ((check.flags & EXCLUSIVE_MAXIMUM) && number == check.maximum))) {
+                return fail(problem, where, element, " is out of range");
+            }
+        }
+        if (type == STRING && (check.minLength || check.maxLength != UINT32_MAX)) {
+            CharacterCounter length;
+            decodeString(value, length);
+            if (length.count < check.minLength) {
+                return fail(problem, where, element, " is too short");
+            }
+            if (length.count > check.maxLength) {
+                return fail(problem, where, element, " is too long");
+            }
+        }
+        if (check.enumCount && exact && !matchesEnum(check, type, value, number)) {
+            return fail(problem, where, element, " is not one of the allowed values");
+        }
+        return true;
+    }
+
+    bool checkObject(JsonScanner& in, const Check& check, std::string& problem) const {
+        const Property* properties = properties_.data() + check.firstProperty;
+        uint32_t seen = 0;
+        bool first = true;
+        JsonSpan key, skipped;
+        in.enterObject();
+        while (in.nextMember(key, first)) {
+            uint16_t i = 0;
+            for (; i < check.propertyCount; ++i) {
+                TextMatcher matcher{text_.data() + properties[i].name, properties[i].length};
+                decodeString(key, matcher);
+                if (matcher.matches()) {
+                    break;
+                }
+            }
+            if (i == check.propertyCount) {
+                if (check.flags & CLOSED) {
+                    return fail(problem, std::string_view(key.begin + 1, key.size() - 2), false, " is not allowed");
+                }
+                in.scanValue(skipped, kNestingLimit);
+                continue;
+            }
+            if (i < 32) {
+                seen |= 1u << i;
+            }
+            const std::string_view name(text_.data() + properties[i].name, properties[i].length);
+            if (properties[i].check == kAny) {
+                in.scanValue(skipped, kNestingLimit);
+            } else if (!checkValue(in, properties[i].check, name, false, problem)) {
+                return false;
+            }
+        }
+
+        const uint32_t missing = check.required & ~seen;
+        if (missing) {
+            const Property& absent = properties[__builtin_ctz(missing)];
+            return fail(problem, std::string_view(text_.data() + absent.name, absent.length), false, " is required");
+        }
+        return true;
+    }
+
+    bool checkArray(JsonScanner& in, const Check& check, std::string_view where, bool element,
+                    std::string& problem) const {
+        uint32_t count = 0;
+        bool first = true;
+        JsonSpan skipped;
+        in.enterArray();
+        while (in.nextElement(first)) {
+            ++count;
+            if (check.items == kAny) {
+                in.scanValue(skipped, kNestingLimit);
+            } else if (!checkValue(in, check.items, where, true, problem)) {
+                return false;
+            }
+        }
+        if (count < check.minItems) {
+            return fail(problem, where, element, " has too few items");
+        }
+        if (count > check.maxItems) {
+            return fail(problem, where, element, " has too many items");
+        }
+        return true;
+    }
+
+    std::vector<Check> checks_;
+    std::vector<Property> properties_;
+    std::vector<EnumValue> enums_;
+    std::string text_;  // property names and enum strings
+    uint16_t root_ = kAny;
+};
+
+// ---------------------------------------------------------------------------
+// Request arena
+// ---------------------------------------------------------------------------
+
+namespace {
+
+/* ArduinoJson's own default with the placement policy applied: the upstream of
+ * every arena, and the allocator of documents built outside any arena scope. */
+struct HeapAllocator : ArduinoJson::Allocator {
+    void* allocate(size_t size) override {
+        return mcpPlacedAlloc(size);
+    }
+    void deallocate(void* ptr) override {
+        free(ptr);
+    }
+    void* reallocate(void* ptr, size_t newSize) override {
+        return placedRealloc(ptr, newSize);
+    }
+};
+
+HeapAllocator s_heapAllocator;
+thread_local ArduinoJson::Allocator* t_scopeAllocator = nullptr;
+
+constexpr size_t kArenaAlign = alignof(std::max_align_t);
+
+constexpr size_t arenaRound(size_t size) {
+    return (size + kArenaAlign - 1) & ~(kArenaAlign - 1);
+}
+
+// Each allocation is preceded by its size, for reallocate()'s copy.
+constexpr size_t kArenaSlotHeader = arenaRound(sizeof(size_t));
+
+}  // namespace
+
+struct MCPArena::Block {
+    Block* next;
+    size_t capacity;  // bytes of data()
+    size_t used;
+
+    unsigned char* data() {
+        return reinterpret_cast<unsigned char*>(this) + arenaRound(sizeof(Block));
+    }
+};
+
+MCPArena::MCPArena(ArduinoJson::Allocator* upstream)
+    : upstream_(upstream ? upstream : &s_heapAllocator), blocks_(nullptr), lastBlock_(nullptr), last_(nullptr), refs_(1) {}
+
+MCPArena::~MCPArena() {
+    while (blocks_) {
+        Block* next = blocks_->next;
+        upstream_->deallocate(blocks_);
+        blocks_ = next;
+    }
+}
+
+void* MCPArena::allocate(size_t size) {
+    size_t need = kArenaSlotHeader + arenaRound(size);
+    if (blocks_ && blocks_->capacity - blocks_->used >= need) {
+        return allocateFrom(blocks_, size);
+    }
+
+    const bool dedicated = need > MCP_REQUEST_ARENA_BLOCK_SIZE;
+    size_t capacity = dedicated ? need : MCP_REQUEST_ARENA_BLOCK_SIZE;
+    auto* block = static_cast<Block*>(upstream_->allocate(arenaRound(sizeof(Block)) + capacity));
+    if (!block) {
+        return nullptr;
+    }
+    block->capacity = capacity;
+    block->used = 0;
+    if (dedicated && blocks_) {
+        // Filled by this one allocation; the head keeps serving small ones.
+        block->next = blocks_->next;
+        blocks_->next = block;
+    } else {
+        block->next = blocks_;
+        blocks_ = block;
+    }
+    return allocateFrom(block, size);
+}
+
+void* MCPArena::allocateFrom(Block* block, size_t size) {
+    unsigned char* slot = block->data() + block->used;
+    memcpy(slot, &size, sizeof(size));
+    block->used += kArenaSlotHeader + arenaRound(size);
+    lastBlock_ = block;
+    last_ = slot + kArenaSlotHeader;
+    return last_;
+}
+
+void MCPArena::deallocate(void* ptr) {
+    if (ptr && ptr == last_) {
+        lastBlock_->used = static_cast<size_t>(static_cast<unsigned char*>(ptr) - lastBlock_->data()) - kArenaSlotHeader;
+        last_ = nullptr;
+    }
+}
+
+void* MCPArena::reallocate(void* ptr, size_t newSize) {
+    if (!ptr) {
+        return allocate(newSize);
+    }
+    size_t oldSize;
+    memcpy(&oldSize, static_cast<unsigned char*>(ptr) - kArenaSlotHeader, sizeof(oldSize));
+
+    if (ptr == last_) {
+        // The newest allocation grows or shrinks where it stands when it can.
+        Block* block = lastBlock_;
+        size_t start = static_cast<size_t>(static_cast<unsigned char*>(ptr) - block->data());
+        if (start + arenaRound(newSize) <= block->capacity) {
+            block->used = start + arenaRound(newSize);
+            memcpy(static_cast<unsigned char*>(ptr) - kArenaSlotHeader, &newSize, sizeof(newSize));
+            return ptr;
+        }
+        void* moved = allocate(newSize);
+        if (moved) {
+            memcpy(moved, ptr, oldSize);
+            block->used = start - kArenaSlotHeader;  // nothing was placed after it
+        }
+        return moved;
+    }
+
+    if (newSize <= oldSize) {
+        return ptr;
+    }
+    void* moved = allocate(newSize);
+    if (moved) {
+        memcpy(moved, ptr, oldSize);
+    }
+    return moved;
+}
+
+size_t MCPArena::blockCount() const {
+    size_t count = 0;
+    for (Block* block = blocks_; block; block = block->next) {
+        ++count;
+    }
+    return count;
+}
+
+MCPArena::Ref::Ref(MCPArena* arena) : arena_(arena) {
+    if (arena_) {
+        arena_->refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+MCPArena::Ref::~Ref() {
+    if (arena_ && arena_->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete arena_;
+    }
+}
+
+MCPArena::Ref MCPArena::create(ArduinoJson::Allocator* upstream) {
+#if MCP_REQUEST_ARENA_BLOCK_SIZE > 0
+    return Ref(new (std::nothrow) MCPArena(upstream), Ref::Adopt{});
+#else
+    (void)upstream;
+    return Ref();
+#endif
+}
+
+MCPArena::Scope::Scope(ArduinoJson::Allocator* allocator) : previous_(t_scopeAllocator) {
+    t_scopeAllocator = allocator;
+}
+
+MCPArena::Scope::~Scope() {
+    t_scopeAllocator = previous_;
+}
+
+ArduinoJson::Allocator* MCPArena::Scope::allocator() {
+    return t_scopeAllocator ? t_scopeAllocator : &s_heapAllocator;
+}
+
+// ---------------------------------------------------------------------------
+// Request and reply
+// ---------------------------------------------------------------------------
+
+MCPId::MCPId(JsonVariantConst value) : inline_{} {
+    if (value.is<const char*>()) {
+        JsonString string = value.as<JsonString>();
+        assign(Kind::STRING, string.c_str(), string.size());
+    } else if (value.is<double>()) {  // integers too
+        char text[32];
+        size_t length = serializeJson(value, text, sizeof(text));
+        assign(Kind::NUMBER, text, length);
+    }
+}
+
+MCPId::MCPId(const MCPId& other) : inline_{} {
+    assign(other.kind_, other.text(), other.length_);
+}
+
+MCPId::MCPId(MCPId&& other) noexcept : inline_{} {
+    *this = std::move(other);
+}
+
+MCPId& MCPId::operator=(const MCPId& other) {
+    if (this != &other) {
+        assign(other.kind_, other.text(), other.length_);
+    }
+    return *this;
+}
+
+MCPId& MCPId::operator=(MCPId&& other) noexcept {
+    if (this != &other) {
+        release();
+        memcpy(inline_, other.inline_, sizeof(inline_));  // the text, or the spill pointer
+        length_ = other.length_;
+        kind_ = other.kind_;
+        other.length_ = 0;
+        other.inline_[0] = '\0';
+        other.kind_ = Kind::NONE;
+    }
+    return *this;
+}
+
+MCPId::~MCPId() {
+    release();
+}
+
+char* MCPId::reserve(Kind kind, size_t capacity) {
+    release();
+    if (kind == Kind::NONE) {
+        return nullptr;
+    }
+    char* out = inline_;
+    if (capacity > kInline) {
+        out = static_cast<char*>(malloc(capacity + 1));
+        if (!out) {
+            return nullptr;
+        }
+        heap_ = out;
+    }
+    length_ = static_cast<uint32_t>(capacity);
+    kind_ = kind;
+    return out;
+}
+
+void MCPId::setLength(size_t length) {
+    if (length_ > kInline && length <= kInline) {
+        char* spilled = heap_;
+        memcpy(inline_, spilled, length);
+        free(spilled);
+    }
+    length_ = static_cast<uint32_t>(length);
+    (length_ <= kInline ? inline_ : heap_)[length_] = '\0';
+}
+
+void MCPId::assign(Kind kind, const char* text, size_t length) {
+    char* out = reserve(kind, length);
+    if (out) {
+        memcpy(out, text, length);
+        setLength(length);
+    }
+}
+
+void MCPId::release() {
+    if (length_ > kInline) {
+        free(heap_);
+    }
+    length_ = 0;
+    inline_[0] = '\0';
+    kind_ = Kind::NONE;
+}
+
+MCPResponse::MCPResponse(const MCPResponse& other)
+    : rpcId(other.rpcId),
+      code(other.code),
+      textSource(other.textSource),
+      toolError(other.toolError),
+      body(other.body) {
+    copyBody(other);
+}
+
+MCPResponse::MCPResponse(MCPResponse&& other) noexcept
+    : rpcId(std::move(other.rpcId)),
+      code(other.code),
+      textSource(other.textSource),
+      toolError(other.toolError),
+      body(other.body) {
+    takeBody(other);
+}
+
+MCPResponse& MCPResponse::operator=(const MCPResponse& other) {
+    if (this != &other) {
+        rpcId = other.rpcId;
+        code = other.code;
+        textSource = other.textSource;
+        toolError = other.toolError;
+        body = other.body;
+        copyBody(other);
+    }
+    return *this;
+}
+
+MCPResponse& MCPResponse::operator=(MCPResponse&& other) noexcept {
+    if (this != &other) {
+        rpcId = std::move(other.rpcId);
+        code = other.code;
+        textSource = other.textSource;
+        toolError = other.toolError;
+        body = other.body;
+        takeBody(other);
+    }
+    return *this;
+}
+
+JsonDocument& MCPResponse::resultDoc() {
+    reset(Kind::RESULT);
+    return slot_.doc;
+}
+
+JsonDocument& MCPResponse::errorDoc() {
+    reset(Kind::ERROR);
+    return slot_.doc;
+}
+
+std::shared_ptr<const JsonText>& MCPResponse::rawResult() {
+    reset(Kind::RAW);
+    return slot_.raw;
+}
+
+void MCPResponse::reset(Kind kind) {
+    if (kind == kind_) {
+        return;
+    }
+    if (kind_ == Kind::RESULT || kind_ == Kind::ERROR) {
+        slot_.doc.~JsonDocument();
+    } else if (kind_ == Kind::RAW) {
+        slot_.raw.~shared_ptr();
+    }
+    if (kind == Kind::RESULT || kind == Kind::ERROR) {
+        new (&slot_.doc) JsonDocument(MCPArena::Scope::allocator());
+    } else if (kind == Kind::RAW) {
+        new (&slot_.raw) std::shared_ptr<const JsonText>();
+    }
+    kind_ = kind;
+}
+
+// A deep copy, into the current scope rather than the other reply's arena.
+void MCPResponse::copyBody(const MCPResponse& other) {
+    reset(Kind::NONE);
+    reset(other.kind_);
+    if (kind_ == Kind::RESULT || kind_ == Kind::ERROR) {
+        slot_.doc.set(other.slot_.doc);
+    } else if (kind_ == Kind::RAW) {
+        slot_.raw = other.slot_.raw;
+    }
+}
+
+void MCPResponse::takeBody(MCPResponse& other) {
+    reset(Kind::NONE);
+    if (other.kind_ == Kind::RESULT || other.kind_ == Kind::ERROR) {
+        new (&slot_.doc) JsonDocument(std::move(other.slot_.doc));
+    } else if (other.kind_ == Kind::RAW) {
+        new (&slot_.raw) std::shared_ptr<const JsonText>(std::move(other.slot_.raw));
+    }
+    kind_ = other.kind_;
+    other.reset(Kind::NONE);
+}
+
+// ---------------------------------------------------------------------------
+// Schema builder
+// ---------------------------------------------------------------------------
+
+static constexpr uint32_t kNoSchemaNode = UINT32_MAX;
+
+struct Schema::Node {
+    JsonVariant keywords;        // an element of the store's document
+    JsonVariant nameSlot;        // another, holding `name`
+    const char* name = nullptr;  // a property's name
+    uint32_t firstChild = kNoSchemaNode;
+    uint32_t next = kNoSchemaNode;  // the parent's next child
+    uint32_t refs = 0;              // Schemas rooted here, plus the parent it is linked under
+    Slot slot = Slot::NONE;
+};
+
+/* A node is freed when the last Schema or parent holding it lets go, and its
+ * slot, its document elements and their pool memory are reused by the next
+ * node. A Schema kept alive, which keeps the thread's store alive with it,
+ * then pins only its own nodes: later schemas built on the thread reuse the
+ * space of those that are gone rather than growing the store. */
+struct Schema::Store {
+    explicit Store(ArduinoJson::Allocator* allocator) : allocator(allocator), doc(allocator) {}
+
+    // The thread's store for new nodes, replaced when the scope has changed.
+    static Store* current();
+    static Store*& currentSlot();
+    static const char* keyOf(Slot slot);
+    static Slot slotNamed(const char* key);
+
+    void retain() { ++refs; }
+    void release();
+
+    // A new node, with no keywords and no holder yet.
+    uint32_t add();
+    void hold(uint32_t index) { ++nodes[index].refs; }
+    // Lets go of a node, freeing it and dropping its children if that was the last hold.
+    void drop(uint32_t index);
+    void name(uint32_t index, const char* text);
+    uint32_t copy(const Store* from, uint32_t index);
+    void attach(uint32_t parent, uint32_t child);
+    void write(uint32_t index, JsonVariant out) const;
+
+    ArduinoJson::Allocator* allocator;
+    JsonDocument doc;
+    std::vector<Node> nodes;
+    std::vector<uint32_t> freeNodes;
+    size_t refs = 0;
+};
+
+const char* Schema::Store::keyOf(Slot slot) {
+    switch (slot) {
+        case Slot::PROPERTIES:
+            return "properties";
+        case Slot::ITEMS:
+            return "items";
+        case Slot::ONE_OF:
+            return "oneOf";
+        case Slot::ANY_OF:
+            return "anyOf";
+        case Slot::ALL_OF:
+            return "allOf";
+        default:
+            return nullptr;
+    }
+}
+
+Schema::Slot Schema::Store::slotNamed(const char* key) {
+    for (Schema::Slot slot : {Slot::PROPERTIES, Slot::ITEMS, Slot::ONE_OF,
+                              Slot::ANY_OF, Slot::ALL_OF}) {
+        if (strcmp(key, keyOf(slot)) == 0) {
+            return slot;
+        }
+    }
+    return Slot::NONE;
+}
+
+Schema::Store*& Schema::Store::currentSlot() {
+    static thread_local Store* current = nullptr;
+    return current;
+}
+
+Schema::Store* Schema::Store::current() {
+    Store*& current = currentSlot();
+    ArduinoJson::Allocator* allocator = MCPArena::Scope::allocator();
+    if (!current || current->allocator != allocator) {
+        // Null on failure; the Schema is then left unconstrained.
+        current = new (std::nothrow) Store(allocator);
+    }
+    return current;
+}
+
+void Schema::Store::release() {
+    if (--refs == 0) {
+        if (currentSlot() == this) {
+            currentSlot() = nullptr;
+        }
+        delete this;
+    }
+}
+
+uint32_t Schema::Store::add() {
+    if (!freeNodes.empty()) {
+        const uint32_t index = freeNodes.back();
+        freeNodes.pop_back();
+        return index;
+    }
+    nodes.emplace_back();
+    nodes.back().keywords = doc.add<JsonVariant>();
+    nodes.back().nameSlot = doc.add<JsonVariant>();
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void Schema::Store::drop(uint32_t index) {
+    if (--nodes[index].refs > 0) {
+        return;
+    }
+    for (uint32_t child = nodes[index].firstChild; child != kNoSchemaNode;) {
+        const uint32_t next = nodes[child].next;
+        drop(child);
+        child = next;
+    }
+    Node& node = nodes[index];
+    node.keywords.set(nullptr);
+    node.nameSlot.set(nullptr);
+    node.name = nullptr;
+    node.firstChild = node.next = kNoSchemaNode;
+    node.slot = Slot::NONE;
+    freeNodes.push_back(index);
+}
+
+// Every node keeps its own copy of its name, so freeing one never pulls it from another.
+void Schema::Store::name(uint32_t index, const char* text) {
+    Node& node = nodes[index];
+    node.nameSlot.set(text);
+    node.name = node.nameSlot.as<const char*>();
+}
+
+// A deep copy of `from`'s node, as a new unattached node of this store.
+uint32_t Schema::Store::copy(const Store* from, uint32_t index) {
+    uint32_t copied = add();
+    if (!from) {
+        return copied;  // a default-constructed Schema: no keywords at all
+    }
+    const Node& source = from->nodes[index];
+    nodes[copied].keywords.set(source.keywords);
+    nodes[copied].slot = source.slot;
+    name(copied, source.name);
+    for (uint32_t child = from->nodes[index].firstChild; child != kNoSchemaNode; child = from->nodes[child].next) {
+        attach(copied, copy(from, child));
+    }
+    return copied;
+}
 
-    bool canHandle(AsyncWebServerRequest* request) const override {
-        return request->url() == uri_;
+/* Appends `child` to `parent`'s children, which then hold it. Like the
+ * keywords themselves, a second items or a property of the same name replaces
+ * the first, in place. */
+void Schema::Store::attach(uint32_t parent, uint32_t child) {
+    hold(child);
+    const Slot slot = nodes[child].slot;
+    const bool unique = slot == Slot::ITEMS || slot == Slot::PROPERTIES;
+    uint32_t* link = &nodes[parent].firstChild;
+    while (*link != kNoSchemaNode) {
+        Node& sibling = nodes[*link];
+        if (unique && sibling.slot == slot &&
+            (slot == Slot::ITEMS || strcmp(sibling.name, nodes[child].name) == 0)) {
+            const uint32_t replaced = *link;
+            nodes[child].next = sibling.next;
+            *link = child;
+            drop(replaced);
+            return;
+        }
+        link = &sibling.next;
     }
+    nodes[child].next = kNoSchemaNode;
+    *link = child;
+}
 
-    void handleRequest(AsyncWebServerRequest* request) override {
-        onRequest_(request);
+/* Keywords in the order they were first set. Each subschema keyword holds a
+ * placeholder there, filled in from the linked children. */
+void Schema::Store::write(uint32_t index, JsonVariant out) const {
+    const Node& node = nodes[index];
+    if (!node.keywords.is<JsonObjectConst>()) {
+        out.set(node.keywords);
+        return;
+    }
+    JsonObject object = out.to<JsonObject>();
+    for (JsonPairConst keyword : node.keywords.as<JsonObjectConst>()) {
+        JsonVariant value = object[keyword.key()].to<JsonVariant>();
+        const Slot slot = slotNamed(keyword.key().c_str());
+        if (slot == Slot::NONE) {
+            value.set(keyword.value());
+            continue;
+        }
+        if (slot == Slot::PROPERTIES) {
+            value.to<JsonObject>();
+        } else if (slot != Slot::ITEMS) {
+            value.to<JsonArray>();
+        }
+        for (uint32_t child = node.firstChild; child != kNoSchemaNode; child = nodes[child].next) {
+            if (nodes[child].slot != slot) {
+                continue;
+            }
+            if (slot == Slot::PROPERTIES) {
+                write(child, value[nodes[child].name].to<JsonVariant>());
+            } else if (slot == Slot::ITEMS) {
+                write(child, value);
+            } else {
+                write(child, value.add<JsonVariant>());
+            }
+        }
     }
+}
 
-    void handleBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index,
-                    size_t total) override {
-        onBody_(request, data, len, index, total);
+Schema::Schema(const Schema& other) {
+    *this = other;
+}
+
+Schema::Schema(Schema&& other) noexcept : store_(other.store_), node_(other.node_) {
+    other.store_ = nullptr;
+}
+
+Schema& Schema::operator=(const Schema& other) {
+    if (this == &other) {
+        return *this;
+    }
+    Store* store = other.store_;
+    uint32_t node = 0;
+    if (store) {
+        store->retain();
+        node = store->copy(store, other.node_);
+        store->hold(node);
     }
+    reset();
+    store_ = store;
+    node_ = node;
+    return *this;
+}
 
-    // A "trivial" handler never has the request body delivered to it.
-    bool isRequestHandlerTrivial() const override {
-        return false;
+Schema& Schema::operator=(Schema&& other) noexcept {
+    if (this != &other) {
+        reset();
+        store_ = other.store_;
+        node_ = other.node_;
+        other.store_ = nullptr;
     }
+    return *this;
+}
 
-private:
-    String uri_;
-    RequestFn onRequest_;
-    BodyFn onBody_;
-};
+Schema::~Schema() {
+    reset();
+}
 
-/* Appending sink for serializeJson. ArduinoJson's std::string writer clears the
- * destination in its constructor, so emitting several documents into one buffer
- * needs a writer that only ever appends; the default Writer template picks this
- * up by duck-typing on write(). */
-struct StringAppender {
-    std::string* out;
+void Schema::reset() {
+    if (store_) {
+        store_->drop(node_);
+        store_->release();
+        store_ = nullptr;
+    }
+}
 
-    size_t write(uint8_t c) {
-        out->push_back(static_cast<char>(c));
-        return 1;
+JsonVariant Schema::keywords() {
+    if (!store_) {
+        store_ = Store::current();
+        if (!store_) {
+            return JsonVariant();
+        }
+        store_->retain();
+        node_ = store_->add();
+        store_->hold(node_);
     }
+    return store_->nodes[node_].keywords;
+}
 
-    size_t write(const uint8_t* s, size_t n) {
-        out->append(reinterpret_cast<const char*>(s), n);
-        return n;
+Schema& Schema::link(Slot slot, const char* name, const Schema& child) {
+    // The proxy, not a JsonVariant: converting a missing member would not create it.
+    keywords();
+    if (!store_) {
+        return *this;  // out of memory
+    }
+    auto placeholder = keywords()[Store::keyOf(slot)];
+    if (slot == Slot::PROPERTIES || slot == Slot::ITEMS) {
+        if (!placeholder.is<JsonObject>()) {
+            placeholder.to<JsonObject>();
+        }
+    } else if (!placeholder.is<JsonArray>()) {
+        placeholder.to<JsonArray>();
     }
-};
 
-}  // namespace
+    const uint32_t linked = child.store_ == store_ ? child.node_ : store_->copy(child.store_, child.node_);
+    store_->nodes[linked].slot = slot;
+    store_->name(linked, name);
+    store_->attach(node_, linked);
+    return *this;
+}
+
+JsonDocument Schema::build() const {
+    JsonDocument out;
+    if (store_) {
+        store_->write(node_, out.to<JsonVariant>());
+    }
+    return out;
+}
 
 #ifdef MCP_HTTP_TEST_HOOKS
 static int s_fail_next_job_alloc = 0;
@@ -180,6 +2770,8 @@ MCPServer::~MCPServer() {
         server = nullptr;
     }
     stopWorker();
+    SlabPool::release(jobPool);
+    SlabPool::release(bodyPool);
 }
 
 bool MCPServer::begin() {
@@ -192,8 +2784,17 @@ bool MCPServer::begin() {
 
     // Best-effort: on failure tools/call degrades to inline execution.
     startWorker();
+    // Also best-effort: without a pool, its allocations come from the heap.
+    bodyPool = SlabPool::create(sizeof(BodyBuffer) + MCP_HTTP_MAX_BODY_SIZE, MCP_HTTP_BODY_POOL_SLOTS);
+    if (worker_handle) {
+        jobPool = SlabPool::create(sizeof(HttpToolJob), MCP_HTTP_JOB_QUEUE_DEPTH + 2);
+    }
     if (!setupWebServer()) {
         stopWorker();  // nothing will ever feed it
+        SlabPool::release(jobPool);
+        SlabPool::release(bodyPool);
+        jobPool = nullptr;
+        bodyPool = nullptr;
         return false;
     }
     setupMDNS();
@@ -266,15 +2867,34 @@ void MCPServer::stopWorker() {
 void MCPServer::workerEntry(void* ctx) {
     auto* self = static_cast<MCPServer*>(ctx);
     HttpToolJob* job = nullptr;
+    unsigned long lastSweep = millis();
     for (;;) {
-        if (xQueueReceive(self->job_queue, &job, portMAX_DELAY) == pdTRUE) {
+        /* Idle handlers are swept between jobs, so never while one of them
+         * runs, and at least every MCP_IDLE_SWEEP_MS even under steady load.
+         * With no handler that can go idle, the task sleeps until a job. */
+        const bool sweep = self->idle_sweep.load(std::memory_order_relaxed);
+        if (sweep && millis() - lastSweep >= MCP_IDLE_SWEEP_MS) {
+            self->evictIdleHandlers();
+            lastSweep = millis();
+        }
+        const TickType_t wait = sweep ? pdMS_TO_TICKS(MCP_IDLE_SWEEP_MS) : portMAX_DELAY;
+        if (xQueueReceive(self->job_queue, &job, wait) == pdTRUE) {
             if (self->worker_exit.load(std::memory_order_acquire)) {
                 HttpToolJob::release(job);  // sentinel (null) or an undelivered job
                 break;
             }
             if (job) {
-                MCPResponse mcpResponse = self->handle(job->request);
-                job->response = self->serializeResponse(mcpResponse);
+                MCPArena::Scope scope(job->arena.get());
+                // The arguments tree is built here rather than on async_tcp;
+                // the body is not needed past this point.
+                self->materializeRequest(job->request);
+                releaseBody(job->body);
+                job->body = nullptr;
+
+                /* The reply is left as a tree; async_tcp serializes it as the
+                 * TCP window opens, so the text never exists in full. */
+                job->response = self->handle(job->request);
+                job->stream.reset(job->response);
                 job->done.store(true, std::memory_order_release);
                 HttpToolJob::release(job);
                 job = nullptr;
@@ -313,10 +2933,23 @@ bool MCPServer::setupWebServer() {
                     status = BODY_TOO_LARGE;
                     cap = 0;
                 }
-                body = static_cast<BodyBuffer*>(malloc(sizeof(BodyBuffer) + cap));
-                if (!body) {
-                    return;  // handlePostComplete reports the OOM
+                /* A rejected body stores nothing, so it never ties up one of
+                 * the pool's full-size slots. */
+                SlabPool* pool = status == BODY_OK ? bodyPool : nullptr;
+                body = pool ? static_cast<BodyBuffer*>(pool->take()) : nullptr;
+                if (body) {
+                    request->onDisconnect([request] {
+                        releaseBody(static_cast<BodyBuffer*>(request->_tempObject));
+                        request->_tempObject = nullptr;
+                    });
+                } else {
+                    pool = nullptr;
+                    body = static_cast<BodyBuffer*>(mcpPlacedAlloc(sizeof(BodyBuffer) + cap));
+                    if (!body) {
+                        return;  // handlePostComplete reports the OOM
+                    }
                 }
+                body->pool = pool;
                 body->received = 0;
                 body->status = status;
                 request->_tempObject = body;
@@ -446,10 +3079,7 @@ std::string MCPServer::mdnsHostname() const {
  * with createJSONRPCError(request.id()) instead so the id is echoed. */
 void MCPServer::sendJSONRPCError(AsyncWebServerRequest* request, int httpCode, ErrorCode rpcCode,
                                  const char* message) {
-    JsonDocument nullId;
-    nullId.set(nullptr);
-    MCPResponse error =
-        createJSONRPCError(httpCode, static_cast<int>(rpcCode), nullId.as<JsonVariantConst>(), message);
+    MCPResponse error = createJSONRPCError(httpCode, static_cast<int>(rpcCode), MCPId(), message);
     sendMCPResponse(request, error);
 }
 
@@ -458,7 +3088,7 @@ void MCPServer::handlePostComplete(AsyncWebServerRequest* request) {
 
     if (!validateOriginHeader(request)) {
         if (body) {
-            free(body);
+            releaseBody(body);
             request->_tempObject = nullptr;
         }
         sendJSONRPCError(request, 403, ErrorCode::INVALID_REQUEST, "Forbidden Origin");
@@ -467,7 +3097,7 @@ void MCPServer::handlePostComplete(AsyncWebServerRequest* request) {
 
     if (!isJsonContentType(request->contentType())) {
         if (body) {
-            free(body);
+            releaseBody(body);
             request->_tempObject = nullptr;
         }
         sendJSONRPCError(request, 415, ErrorCode::INVALID_REQUEST, "Content-Type must be application/json");
@@ -477,7 +3107,7 @@ void MCPServer::handlePostComplete(AsyncWebServerRequest* request) {
     if (!body) {
         if (request->contentLength() == 0) {
             // No body at all; let the parser produce the JSON-RPC parse error.
-            handleJsonBody(request, "");
+            handleJsonBody(request, "", 0);
             return;
         }
         // The body callback could not allocate the accumulation buffer.
@@ -489,7 +3119,7 @@ void MCPServer::handlePostComplete(AsyncWebServerRequest* request) {
     const size_t received = body->received;
     if (status == BODY_OK && received == request->contentLength()) {
         body->data[received] = '\0';
-        handleJsonBody(request, body->data);
+        handleJsonBody(request, body->data, received);
     } else if (status == BODY_TOO_LARGE) {
         sendJSONRPCError(request, 413, ErrorCode::INVALID_REQUEST, "Request body too large");
     } else if (status == BODY_NO_LENGTH) {
@@ -498,12 +3128,23 @@ void MCPServer::handlePostComplete(AsyncWebServerRequest* request) {
         sendJSONRPCError(request, 400, ErrorCode::INVALID_REQUEST, "Incomplete request body");
     }
 
-    free(body);
+    // Null when deferToolCall handed the body to a job.
+    releaseBody(static_cast<BodyBuffer*>(request->_tempObject));
     request->_tempObject = nullptr;
 }
 
-void MCPServer::handleJsonBody(AsyncWebServerRequest* request, const char* body) {
-    MCPRequest mcpReq = parseRequest(body);
+void MCPServer::handleJsonBody(AsyncWebServerRequest* request, const char* body, size_t length) {
+    /* Envelope only: a request turned away for its MCP-Protocol-Version
+     * header, its envelope or an unknown method is answered from the scan and
+     * never has a tree built for its params. The scan allocates nothing, which
+     * is all async_tcp pays for a tools/call. */
+    /* Every document of the request and its reply comes out of one arena.
+     * On the deferred path the job takes a share of it to the worker, and
+     * async_tcp builds no document once the job is queued, so the two tasks
+     * never allocate from it at the same time. */
+    MCPArena::Ref arena = MCPArena::create();
+    MCPArena::Scope scope(arena.get());
+    MCPRequest mcpReq = scanRequest(body, length);
 
     if (!validateProtocolVersionHeader(request)) {
         MCPResponse invalidVersion = createJSONRPCError(400, static_cast<int>(ErrorCode::INVALID_PARAMS),
@@ -512,20 +3153,34 @@ void MCPServer::handleJsonBody(AsyncWebServerRequest* request, const char* body)
         return;
     }
 
+    /* Arguments the tool's inputSchema rejects are answered here, from the
+     * scanned text: such a call never takes a queue slot or reaches the
+     * worker, and no tree is built for it. */
+    std::string problem;
+    if (mcpReq.method == MCPMethod::TOOLS_CALL && !mcpReq.isNotification() && !checkArguments(mcpReq, problem)) {
+        MCPResponse invalid = createJSONRPCError(200, static_cast<int>(ErrorCode::INVALID_PARAMS), mcpReq.id(),
+                                                 "Invalid arguments: " + problem);
+        sendMCPResponse(request, invalid);
+        return;
+    }
+
     /* tools/call runs user code of unknown duration, so it executes on the
-     * worker task and is answered with a deferred chunked response. Everything
-     * else — protocol methods, notifications, malformed requests — is pure
-     * in-memory JSON work and stays inline. */
-    if (worker_handle && mcpReq.method == "tools/call" && !mcpReq.isNotification()) {
-        deferToolCall(request, std::move(mcpReq));
+     * worker task and is answered with a deferred chunked response. Its
+     * arguments can be as large as the body limit, so building their tree is
+     * left to the worker too. Everything else — protocol methods,
+     * notifications, malformed requests — is small in-memory JSON work and
+     * stays inline. */
+    if (worker_handle && mcpReq.method == MCPMethod::TOOLS_CALL && !mcpReq.isNotification()) {
+        deferToolCall(request, std::move(mcpReq), arena);
         return;
     }
 
+    materializeRequest(mcpReq);
     MCPResponse mcpRes = handle(mcpReq);
     sendMCPResponse(request, mcpRes);
 }
 
-void MCPServer::deferToolCall(AsyncWebServerRequest* request, MCPRequest&& mcpRequest) {
+void MCPServer::deferToolCall(AsyncWebServerRequest* request, MCPRequest&& mcpRequest, MCPArena::Ref arena) {
     /* Deferred responses rely on chunked framing, which needs HTTP/1.1.
      * ESPAsyncWebServer would cope with a version-0 request on its own —
      * beginChunkedResponse routes it to a non-chunked response whose body is
@@ -545,10 +3200,10 @@ void MCPServer::deferToolCall(AsyncWebServerRequest* request, MCPRequest&& mcpRe
     if (s_fail_next_job_alloc > 0) {
         s_fail_next_job_alloc--;
     } else {
-        job = new (std::nothrow) HttpToolJob();
+        job = HttpToolJob::create(jobPool, std::move(arena));
     }
 #else
-    job = new (std::nothrow) HttpToolJob();
+    job = HttpToolJob::create(jobPool, std::move(arena));
 #endif
     if (!job) {
         /* Graceful in both exception modes: a client hammering a device that
@@ -561,6 +3216,10 @@ void MCPServer::deferToolCall(AsyncWebServerRequest* request, MCPRequest&& mcpRe
         return;
     }
     job->request = std::move(mcpRequest);
+    /* The request's payload span points into the body, so the job takes the
+     * buffer with it; handlePostComplete must not free it now. */
+    job->body = static_cast<BodyBuffer*>(request->_tempObject);
+    request->_tempObject = nullptr;
 
     job->refs.fetch_add(1, std::memory_order_relaxed);  // the queue/worker reference
     if (xQueueSend(job_queue, &job, 0) != pdTRUE) {
@@ -597,9 +3256,13 @@ void MCPServer::deferToolCall(AsyncWebServerRequest* request, MCPRequest&& mcpRe
     }
     if (ref->done.load(std::memory_order_acquire)) {
         /* Plain, length-delimited response: no chunk framing, and one fewer
-         * round of filler callbacks. */
-        AsyncWebServerResponse* inlineResponse =
-            request->beginResponse(200, "application/json", ref->response.c_str());
+         * round of filler callbacks. Still streamed from the tree; the
+         * Content-Length costs one extra pass, but no buffer. */
+        auto* inlineResponse = new (std::nothrow) StreamedJobResponse(std::move(ref));
+        if (!inlineResponse) {
+            request->send(500);
+            return;
+        }
         inlineResponse->addHeader("MCP-Protocol-Version", PROTOCOL_VERSION);
         request->send(inlineResponse);
         return;
@@ -618,32 +3281,31 @@ void MCPServer::deferToolCall(AsyncWebServerRequest* request, MCPRequest&& mcpRe
             if (!ref->done.load(std::memory_order_acquire)) {
                 return RESPONSE_TRY_AGAIN;
             }
-            const std::string& payload = ref->response;
-            if (index >= payload.size()) {
-                return 0;
-            }
-            size_t n = payload.size() - index;
-            if (n > maxLen) {
-                n = maxLen;
-            }
-            memcpy(buffer, payload.data() + index, n);
-            return n;
+            (void)index;  // the stream keeps its own position
+            return ref->stream.read(buffer, maxLen);
         });
     httpResponse->addHeader("MCP-Protocol-Version", PROTOCOL_VERSION);
     request->send(httpResponse);
 }
 
 void MCPServer::sendMCPResponse(AsyncWebServerRequest* request, const MCPResponse& response) {
-    std::string jsonResponse = serializeResponse(response);
-    if (!response.hasBody() || jsonResponse.empty()) {
+    if (!response.hasBody()) {
+        request->send(response.code);
+        return;
+    }
+    if (response.kind() == MCPResponse::Kind::RAW) {
+        sendSharedResult(request, response);
+        return;
+    }
+    // Straight into a placed string; serializeResponse's copy is for tests.
+    PlacedString jsonResponse;
+    serializeInto(response, jsonResponse);
+    if (jsonResponse.empty()) {
         request->send(response.code);
         return;
     }
 
-    AsyncWebServerResponse* httpResponse =
-        request->beginResponse(response.code, "application/json", jsonResponse.c_str());
-    httpResponse->addHeader("MCP-Protocol-Version", PROTOCOL_VERSION);
-    request->send(httpResponse);
+    sendOwnedBody(request, response.code, std::move(jsonResponse));
 }
 
 bool MCPServer::validateProtocolVersionHeader(AsyncWebServerRequest* request) {
@@ -702,78 +3364,397 @@ bool MCPServer::validateOriginHeader(AsyncWebServerRequest* request) {
 // Protocol layer
 // ---------------------------------------------------------------------------
 
+ToolString ToolString::copy(const char* text, size_t length) {
+    ToolString out;
+    out.owned_.reset(static_cast<char*>(mcpPlacedAlloc(length + 1)));
+    if (!out.owned_) {
+        return out;
+    }
+    memcpy(out.owned_.get(), text, length);
+    out.owned_.get()[length] = '\0';
+    out.text_ = out.owned_.get();
+    out.length_ = length;
+    return out;
+}
+
+/* A Tool::factory and the handler it built, if any. Its own mutex, not
+ * toolsMutex, serializes building: a slow constructor then holds up only the
+ * calls that need this one tool. */
+class LazyToolHandler {
+public:
+    LazyToolHandler(std::function<std::shared_ptr<ToolHandler>()> factory, uint32_t idleTimeoutMs)
+        : factory_(std::move(factory)), idleTimeoutMs_(idleTimeoutMs) {}
+
+    // Null when the factory returned null; anything it throws is passed on.
+    std::shared_ptr<ToolHandler> acquire() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!handler_) {
+            handler_ = factory_();
+        }
+        lastUsed_ = millis();
+        return handler_;
+    }
+
+    /* Hands back the handler if it has been idle past the timeout, for the
+     * caller to destroy outside any lock. One still held by a call is not
+     * idle, however long ago that call began. */
+    std::shared_ptr<ToolHandler> takeIfIdle(unsigned long now) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (idleTimeoutMs_ == 0 || !handler_ || handler_.use_count() > 1 || now - lastUsed_ < idleTimeoutMs_) {
+            return nullptr;
+        }
+        return std::move(handler_);
+    }
+
+private:
+    std::function<std::shared_ptr<ToolHandler>()> factory_;
+    const uint32_t idleTimeoutMs_;
+    std::mutex mutex_;
+    std::shared_ptr<ToolHandler> handler_;
+    unsigned long lastUsed_ = 0;
+};
+
+namespace {
+
+// `factory` is the tool's own, copied or moved out of it by the caller.
+std::shared_ptr<LazyToolHandler> lazyHandler(const Tool& tool,
+                                             std::function<std::shared_ptr<ToolHandler>()> factory) {
+    if (tool.handler || tool.function || !factory) {
+        return nullptr;
+    }
+    return std::make_shared<LazyToolHandler>(std::move(factory), tool.idleTimeoutMs);
+}
+
+ToolString toolString(const char* literal, const String& text) {
+    return literal ? ToolString::literal(literal) : ToolString::copy(text.c_str(), text.length());
+}
+
+}  // namespace
+
 void MCPServer::RegisterTool(const Tool& tool) {
+    RegisteredTool registered;
+    registered.name = toolString(tool.staticName, tool.name);
+    registered.description = toolString(tool.staticDescription, tool.description);
+    registered.handler = tool.handler;
+    registered.function = tool.function;
+    registered.lazy = lazyHandler(tool, tool.factory);
+    addTool(std::move(registered), tool);
+}
+
+void MCPServer::RegisterTool(Tool&& tool) {
+    RegisteredTool registered;
+    registered.name = toolString(tool.staticName, tool.name);
+    registered.description = toolString(tool.staticDescription, tool.description);
+    registered.lazy = lazyHandler(tool, std::move(tool.factory));
+    registered.handler = std::move(tool.handler);
+    registered.function = std::move(tool.function);
+    addTool(std::move(registered), tool);
+}
+
+/* Everything that reads the schema trees happens here, before the lock: the
+ * argument filter is compiled from the input schema and both are serialized.
+ * Only the text is kept. A static schema is kept where it is; the input one is
+ * still parsed once, for the filter, and the tree dropped again. */
+void MCPServer::addTool(RegisteredTool&& registered, const Tool& tool) {
+    std::shared_ptr<const JsonDocument> filter;
+    std::shared_ptr<const ArgumentValidator> validator;
+    if (tool.staticInputSchema) {
+        JsonDocument inputSchema;
+        deserializeJson(inputSchema, tool.staticInputSchema);
+        filter = compileArgumentFilter(inputSchema.as<JsonVariantConst>());
+        validator = ArgumentValidator::compile(inputSchema.as<JsonVariantConst>());
+        registered.inputSchema = JsonText(tool.staticInputSchema);
+    } else {
+        filter = compileArgumentFilter(tool.inputSchema.as<JsonVariantConst>());
+        validator = ArgumentValidator::compile(tool.inputSchema.as<JsonVariantConst>());
+        registered.inputSchema = serializeSchema(tool.inputSchema.as<JsonVariantConst>());
+    }
+    if (tool.staticOutputSchema) {
+        registered.outputSchema = JsonText(tool.staticOutputSchema);
+    } else if (!tool.outputSchema.isNull()) {
+        registered.outputSchema = serializeSchema(tool.outputSchema.as<JsonVariantConst>());
+    }
+
+    /* The key views the entry's own name, whose storage the move below keeps.
+     * An entry being replaced goes first, with its filter: both keys view the
+     * name it is about to free. */
+    if (registered.lazy && tool.idleTimeoutMs > 0) {
+        idle_sweep.store(true, std::memory_order_relaxed);
+    }
+
+    const std::string_view name = registered.name.view();
     std::lock_guard<std::mutex> lock(toolsMutex);
-    tools[std::string(tool.name.c_str())] = tool;
+    argumentFilters.erase(name);
+    argumentValidators.erase(name);
+    tools.erase(name);
+    tools.emplace(name, std::move(registered));
+    setArgumentFilter(name, std::move(filter));
+    setArgumentValidator(name, std::move(validator));
     toolsListDirty = true;
 }
 
-void MCPServer::RegisterTool(Tool&& tool) {
+/* As addTool, each input schema is parsed once here to compile its filter and
+ * validator; the names, descriptions and schema text are used where they are. */
+void MCPServer::registerToolTable(const StaticTool* table, size_t count, JsonText toolsList) {
+    std::vector<std::shared_ptr<const JsonDocument>> filters(count);
+    std::vector<std::shared_ptr<const ArgumentValidator>> validators(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (table[i].inputSchema) {
+            JsonDocument inputSchema;
+            deserializeJson(inputSchema, table[i].inputSchema);
+            filters[i] = compileArgumentFilter(inputSchema.as<JsonVariantConst>());
+            validators[i] = ArgumentValidator::compile(inputSchema.as<JsonVariantConst>());
+        }
+    }
+
     std::lock_guard<std::mutex> lock(toolsMutex);
-    std::string key(tool.name.c_str());
-    tools[key] = std::move(tool);
+    for (size_t i = 0; i < staticToolCount; ++i) {
+        argumentFilters.erase(staticTools[i].name);
+        argumentValidators.erase(staticTools[i].name);
+    }
+    staticTools = table;
+    staticToolCount = count;
+    staticToolsList = std::move(toolsList);
+    for (size_t i = 0; i < count; ++i) {
+        setArgumentFilter(table[i].name, std::move(filters[i]));
+        setArgumentValidator(table[i].name, std::move(validators[i]));
+    }
     toolsListDirty = true;
 }
 
+const StaticTool* MCPServer::findStaticTool(const char* name) const {
+    for (size_t i = 0; i < staticToolCount; ++i) {
+        if (std::strcmp(staticTools[i].name, name) == 0) {
+            return &staticTools[i];
+        }
+    }
+    return nullptr;
+}
+
+JsonDocument MCPServer::inputSchemaOf(const std::string& name) {
+    JsonDocument schema;
+    std::lock_guard<std::mutex> lock(toolsMutex);
+    auto it = tools.find(name);
+    if (it != tools.end()) {
+        deserializeJson(schema, it->second.inputSchema.data(), it->second.inputSchema.size());
+    }
+    return schema;
+}
+
+/* INVARIANT: callers must hold toolsMutex. Re-registering a name replaces its
+ * filter, or drops it when the new schema compiles to none. */
+void MCPServer::setArgumentFilter(std::string_view name, std::shared_ptr<const JsonDocument> filter) {
+    if (filter) {
+        argumentFilters[name] = std::move(filter);
+    } else {
+        argumentFilters.erase(name);
+    }
+}
+
+// INVARIANT: callers must hold toolsMutex.
+void MCPServer::setArgumentValidator(std::string_view name, std::shared_ptr<const ArgumentValidator> validator) {
+    if (validator) {
+        argumentValidators[name] = std::move(validator);
+    } else {
+        argumentValidators.erase(name);
+    }
+}
+
+bool MCPServer::checkArguments(MCPRequest& request, std::string& problem) {
+    request.argumentsChecked = true;
+    if (!request.hasToolName || request.invalidArguments) {
+        return true;  // handleFunctionCalls answers these
+    }
+
+    // Held by reference count, so the lock does not span the check.
+    std::shared_ptr<const ArgumentValidator> validator;
+    {
+        std::lock_guard<std::mutex> lock(toolsMutex);
+        auto it = argumentValidators.find(request.name);
+        if (it == argumentValidators.end()) {
+            return true;
+        }
+        validator = it->second;
+    }
+
+    // Absent arguments are checked as the empty object the handler sees.
+    static const char kNoArguments[] = "{}";
+    JsonSpan arguments{kNoArguments, kNoArguments + 2};
+    if (request.payloadJson) {
+        arguments = JsonSpan{request.payloadJson, request.payloadJson + request.payloadLength};
+    }
+    return validator->check(arguments, problem);
+}
+
 MCPRequest MCPServer::parseRequest(const std::string& json) {
-    return parseRequest(json.c_str());
+    return parseRequest(json.data(), json.size());
 }
 
 MCPRequest MCPServer::parseRequest(const char* json) {
-    MCPRequest request;
-
     if (!json) {
+        MCPRequest request;
         request.parseError = true;
         return request;
     }
+    return parseRequest(json, strlen(json));
+}
 
-    // Deserialize straight into the request's own document: the parse result is
-    // what we keep, so there is nothing left to copy out of a scratch document.
-    DeserializationError error = deserializeJson(request.doc, json);
+MCPRequest MCPServer::parseRequest(const char* json, size_t length) {
+    MCPRequest request = scanRequest(json, length);
+    materializeRequest(request);
+    return request;
+}
 
-    if (error) {
-        request.doc.clear();  // a failed parse may leave a partial tree behind
-        request.method = "";
+MCPRequest MCPServer::scanRequest(const char* json, size_t length) {
+    MCPRequest request;
+
+    if (!json) {
         request.parseError = true;
         return request;
     }
 
-    if (!request.doc.is<JsonObjectConst>()) {
-        request.invalidRequest = true;
+    JsonScanner scanner(json, json + length);
+    if (scanner.peek() != '{') {
+        // Still has to be valid JSON to be an invalid request rather than a parse error.
+        JsonSpan root;
+        if (scanner.scanValue(root, kNestingLimit)) {
+            request.invalidRequest = true;
+        } else {
+            request.parseError = true;
+        }
         return request;
     }
 
-    JsonObjectConst root = request.doc.as<JsonObjectConst>();
-    JsonVariantConst versionVar = root["jsonrpc"];
-    JsonVariantConst methodVar = root["method"];
-    JsonVariantConst idVar = root["id"];
-    JsonVariantConst paramsVar = root["params"];
+    // Duplicate members resolve to the last one, as they do in ArduinoJson.
+    JsonSpan key, value, versionVar, methodVar, idVar, paramsVar;
+    scanner.enterObject();
+    while (scanner.nextMember(key)) {
+        if (!scanner.scanValue(value, kNestingLimit - 1)) {  // the root is one level already
+            break;
+        }
+        if (stringEquals(key, "jsonrpc")) {
+            versionVar = value;
+        } else if (stringEquals(key, "method")) {
+            methodVar = value;
+        } else if (stringEquals(key, "id")) {
+            idVar = value;
+        } else if (stringEquals(key, "params")) {
+            paramsVar = value;
+        }
+    }
+    if (scanner.failed()) {
+        request.parseError = true;
+        return request;
+    }
 
-    request.hasIdField = !idVar.isUnbound();
-    if (request.hasIdField &&
-        !(idVar.isNull() || idVar.is<const char*>() || idVar.is<double>())) {
+    request.hasIdField = idVar.isSet();
+    if (request.hasIdField && !(idVar.isNull() || idVar.isString() || idVar.isNumber())) {
         request.invalidRequest = true;
         request.hasIdField = false;  // invalid ids must be answered as id:null
         return request;
     }
-    request.idDoc.set(idVar);
+    if (idVar.isString()) {
+        // Decoding only ever shortens the text between the quotes.
+        char* text = request.rpcId.reserve(MCPId::Kind::STRING, idVar.size() - 2);
+        if (text) {
+            IdTextSink sink{text};
+            decodeString(idVar, sink);
+            request.rpcId.setLength(sink.length);
+        }
+    } else if (idVar.isNumber()) {
+        request.rpcId.assign(MCPId::Kind::NUMBER, idVar.begin, idVar.size());
+    }
 
-    if (!versionVar.is<const char*>() || strcmp(versionVar.as<const char*>(), "2.0") != 0 ||
-        !methodVar.is<const char*>()) {
+    if (!stringEquals(versionVar, "2.0") || !methodVar.isString()) {
         request.invalidRequest = true;
         return request;
     }
 
-    if (!paramsVar.isUnbound() && !(paramsVar.is<JsonObjectConst>() || paramsVar.is<JsonArrayConst>())) {
+    if (paramsVar.isSet() && !(paramsVar.isObject() || paramsVar.isArray())) {
         request.invalidRequest = true;
         return request;
     }
 
-    request.method = methodVar.as<const char*>();
+    request.method = classifyMethod(methodVar);
+    if (request.method == MCPMethod::OTHER && !request.isNotification()) {
+        decodeString(methodVar, request.name);  // for the error message
+    }
     request.paramsChecked = true;
+
+    /* Nothing to build for a notification (never answered), an unknown method
+     * (rejected by name) or an absent params. */
+    if (!paramsVar.isSet() || request.isNotification() || request.method == MCPMethod::OTHER) {
+        return request;
+    }
+    if (request.method != MCPMethod::TOOLS_CALL) {
+        request.payloadJson = paramsVar.begin;
+        request.payloadLength = paramsVar.size();
+        return request;
+    }
+
+    /* tools/call: lift the name out and keep only arguments. The span was
+     * validated above, so this walk cannot fail. */
+    if (!paramsVar.isObject()) {
+        return request;
+    }
+    JsonScanner params(paramsVar.begin, paramsVar.end);
+    JsonSpan nameVar, argumentsVar;
+    params.enterObject();
+    while (params.nextMember(key) && params.scanValue(value, kNestingLimit - 2)) {
+        if (stringEquals(key, "name")) {
+            nameVar = value;
+        } else if (stringEquals(key, "arguments")) {
+            argumentsVar = value;
+        }
+    }
+    if (nameVar.isString()) {
+        decodeString(nameVar, request.name);
+        request.hasToolName = true;
+    }
+    if (argumentsVar.isObject()) {
+        request.payloadJson = argumentsVar.begin;
+        request.payloadLength = argumentsVar.size();
+    } else if (argumentsVar.isSet()) {
+        request.invalidArguments = true;
+    }
     return request;
 }
 
+void MCPServer::materializeRequest(MCPRequest& request) {
+    // The text is about to go, so this is the last chance to check it.
+    if (request.method == MCPMethod::TOOLS_CALL && !request.argumentsChecked) {
+        checkArguments(request, request.argumentsProblem);
+    }
+    if (!request.payloadJson) {
+        return;
+    }
+
+    // Held by reference count, so the lock does not span the parse.
+    std::shared_ptr<const JsonDocument> filter;
+    if (request.hasToolName) {
+        std::lock_guard<std::mutex> lock(toolsMutex);
+        auto it = argumentFilters.find(request.name);
+        if (it != argumentFilters.end()) {
+            filter = it->second;
+        }
+    }
+
+    // Deserialize straight into the request's own document: the parse result is
+    // what we keep, so there is nothing left to copy out of a scratch document.
+    DeserializationError error =
+        filter ? deserializeJson(request.doc, request.payloadJson, request.payloadLength,
+                                 DeserializationOption::Filter(filter->as<JsonVariantConst>()))
+               : deserializeJson(request.doc, request.payloadJson, request.payloadLength);
+    request.payloadJson = nullptr;  // the body may be released from here on
+    request.payloadLength = 0;
+
+    if (error) {
+        // The scanner already vouched for the syntax, so this is NoMemory.
+        request.doc.clear();  // a failed parse may leave a partial tree behind
+        request.parseError = true;
+    }
+}
+
 std::string MCPServer::serializeResponse(const MCPResponse& response) {
     if (!response.hasBody()) {
         return "";
@@ -784,24 +3765,7 @@ std::string MCPServer::serializeResponse(const MCPResponse& response) {
      * payload one more time, which on an 8 KiB tool result is the difference
      * between one and two full-size trees resident at once. */
     std::string out;
-    StringAppender sink{&out};
-
-    out += "{\"jsonrpc\":\"2.0\",\"id\":";
-    serializeJson(response.idDoc, sink);  // a null document emits `null`, per spec
-
-    if (!response.rawResult.empty()) {
-        out += ",\"result\":";
-        out += response.rawResult;
-    } else if (!response.resultDoc.isNull()) {
-        out += ",\"result\":";
-        serializeJson(response.resultDoc, sink);
-    }
-    if (response.hasError()) {
-        out += ",\"error\":";
-        serializeJson(response.errorDoc, sink);
-    }
-    out += "}";
-
+    serializeInto(response, out);
     return out;
 }
 
@@ -811,7 +3775,7 @@ MCPResponse MCPServer::handle(MCPRequest& request) {
                                   "Parse error: Invalid JSON");
     }
 
-    if (request.invalidRequest || request.method.empty()) {
+    if (request.invalidRequest || request.method == MCPMethod::NONE) {
         return createJSONRPCError(400, static_cast<int>(ErrorCode::INVALID_REQUEST), request.id(),
                                   "Invalid Request");
     }
@@ -824,20 +3788,21 @@ MCPResponse MCPServer::handle(MCPRequest& request) {
         return MCPResponse(202, false);
     }
 
-    if (request.method == "initialize") {
-        return handleInitialize(request);
-    } else if (request.method == "ping") {
-        return handlePing(request);
-    } else if (request.method == "tools/list") {
-        return handleToolsList(request);
-    } else if (request.method == "tools/call") {
-        return handleFunctionCalls(request);
-    } else if (request.method == "notifications/initialized") {
-        return createJSONRPCError(200, static_cast<int>(ErrorCode::INVALID_REQUEST), request.id(),
-                                  "notifications/initialized must be sent as a notification");
-    } else {
-        return createJSONRPCError(200, static_cast<int>(ErrorCode::METHOD_NOT_FOUND), request.id(),
-                                  "Method not found: " + request.method);
+    switch (request.method) {
+        case MCPMethod::INITIALIZE:
+            return handleInitialize(request);
+        case MCPMethod::PING:
+            return handlePing(request);
+        case MCPMethod::TOOLS_LIST:
+            return handleToolsList(request);
+        case MCPMethod::TOOLS_CALL:
+            return handleFunctionCalls(request);
+        case MCPMethod::NOTIFICATIONS_INITIALIZED:
+            return createJSONRPCError(200, static_cast<int>(ErrorCode::INVALID_REQUEST), request.id(),
+                                      "notifications/initialized must be sent as a notification");
+        default:
+            return createJSONRPCError(200, static_cast<int>(ErrorCode::METHOD_NOT_FOUND), request.id(),
+                                      "Method not found: " + request.name);
     }
 }
 
@@ -852,7 +3817,7 @@ MCPResponse MCPServer::handleInitialize(MCPRequest& request) {
     }
 
     MCPResponse response(200, request.id());
-    JsonObject result = response.resultDoc.to<JsonObject>();
+    JsonObject result = response.resultDoc().to<JsonObject>();
 
     result["protocolVersion"] = negotiateProtocolVersion(params);
 
@@ -874,34 +3839,79 @@ MCPResponse MCPServer::handlePing(MCPRequest& request) {
     MCPResponse response(200, request.id());
     // The spec requires a prompt empty-result response; clients use ping to
     // probe liveness and may drop the connection on a -32601.
-    response.resultDoc.to<JsonObject>();
+    response.resultDoc().to<JsonObject>();
     return response;
 }
 
-/* INVARIANT: callers must hold toolsMutex. The returned reference points into
- * the cache, which a concurrent RegisterTool would rewrite. */
-const std::string& MCPServer::toolsListJson() {
+// INVARIANT: callers must hold toolsMutex.
+std::shared_ptr<const JsonText> MCPServer::toolsListJson() {
     if (!toolsListDirty) {
         return toolsListCache;
     }
+    toolsListDirty = false;
+    if (tools.empty() && staticTools) {
+        // Only the table's tools: its compile-time list is the whole answer.
+        toolsListCache = std::make_shared<JsonText>(staticToolsList);
+        return toolsListCache;
+    }
 
-    JsonDocument doc;
-    JsonObject result = doc.to<JsonObject>();
-    JsonArray toolsArray = result["tools"].to<JsonArray>();
-    for (const auto& [key, value] : tools) {
-        JsonObject tool = toolsArray.add<JsonObject>();
-        tool["name"] = key;
-        tool["description"] = value.description;
-        tool["inputSchema"].set(value.inputSchema);
+    cacheToolEntries();
+
+    // Sized up front, so the whole cache is placed by its final length.
+    CountingSink measured;
+    writeToolsList(tools, staticToolsList, measured);
+    PlacedString list;
+    list.reserve(measured.count);
+    StringAppender<PlacedString> sink{&list};
+    writeToolsList(tools, staticToolsList, sink);
+    toolsListCache = std::make_shared<JsonText>(std::move(list));
+    return toolsListCache;
+}
 
-        if (!value.outputSchema.isNull()) {
-            tool["outputSchema"].set(value.outputSchema);
+/* Only tools registered since the last call are serialized; every other
+ * entry is used as it was cached. INVARIANT: callers must hold toolsMutex. */
+void MCPServer::cacheToolEntries() {
+    for (auto& [name, tool] : tools) {
+        if (tool.listEntry.empty()) {
+            cacheToolEntry(name, tool);
         }
     }
+}
 
-    serializeJson(doc, toolsListCache);  // the std::string writer clears for us
-    toolsListDirty = false;
-    return toolsListCache;
+/* The cursor is the listing position the page starts at. The tool set is
+ * fixed once begin() has run, so a position names the same tool on every
+ * request. INVARIANT: callers must hold toolsMutex. */
+std::shared_ptr<const JsonText> MCPServer::toolsListPage(size_t offset) {
+    cacheToolEntries();
+    const size_t total = tools.size() + staticToolCount;
+    const size_t end = std::min(total, offset + MCP_TOOLS_LIST_PAGE_SIZE);
+
+    std::vector<std::string_view> entries;
+    entries.reserve(end - offset);
+    size_t index = 0;
+    for (auto it = tools.begin(); it != tools.end() && index < end; ++it, ++index) {
+        if (index >= offset) {
+            entries.emplace_back(it->second.listEntry.data(), it->second.listEntry.size());
+        }
+    }
+    // The table's entries are lifted out of its list text, which holds them in order, comma-separated.
+    const char* text = staticToolsList.data() + std::strlen(kStaticToolsListOpen);
+    for (size_t i = 0; i < staticToolCount && index < end; ++i, ++index) {
+        const size_t length = staticToolEntryLength(staticTools[i]);
+        if (index >= offset) {
+            entries.emplace_back(text, length);
+        }
+        text += length + 1;
+    }
+    const std::string nextCursor = end < total ? std::to_string(end) : std::string();
+
+    CountingSink measured;
+    writeToolsListPage(entries, nextCursor, measured);
+    PlacedString page;
+    page.reserve(measured.count);
+    StringAppender<PlacedString> sink{&page};
+    writeToolsListPage(entries, nextCursor, sink);
+    return std::make_shared<JsonText>(std::move(page));
 }
 
 MCPResponse MCPServer::handleToolsList(MCPRequest& request) {
@@ -910,57 +3920,133 @@ MCPResponse MCPServer::handleToolsList(MCPRequest& request) {
                                   "tools/list params must be an object");
     }
 
+    /* A cursor is only ever one this server handed out: the position of a
+     * later page's first tool, in decimal with no leading zero. Anything else,
+     * including a position in the middle of a page, is -32602, as MCP asks. */
+    size_t offset = 0;
+    JsonVariantConst cursor = request.params()["cursor"];
+    if (!cursor.isNull()) {
+        const char* text = cursor.as<const char*>();
+        char* end = nullptr;
+        offset = text && *text >= '1' && *text <= '9' ? std::strtoul(text, &end, 10) : 0;
+        if (offset == 0 || *end != '\0') {
+            return createJSONRPCError(200, static_cast<int>(ErrorCode::INVALID_PARAMS), request.id(), "Invalid cursor");
+        }
+    }
+
     MCPResponse response(200, request.id());
-    // Walking the schema tree once per registration rather than once per request.
-    // The copy happens under the lock; the cache reference must not escape it.
     std::lock_guard<std::mutex> lock(toolsMutex);
-    response.rawResult = toolsListJson();
+    const size_t total = tools.size() + staticToolCount;
+    const bool paged = MCP_TOOLS_LIST_PAGE_SIZE > 0 && total > MCP_TOOLS_LIST_PAGE_SIZE;
+    if (offset != 0 && (!paged || offset >= total || offset % MCP_TOOLS_LIST_PAGE_SIZE != 0)) {
+        return createJSONRPCError(200, static_cast<int>(ErrorCode::INVALID_PARAMS), request.id(), "Invalid cursor");
+    }
+    if (!paged) {
+        /* Only a reference to the cache is taken under the lock. The reply
+         * sends the list straight from it, with just the envelope written per
+         * request. */
+        response.rawResult() = toolsListJson();
+    } else {
+        response.rawResult() = toolsListPage(offset);
+    }
     return response;
 }
 
 MCPResponse MCPServer::handleFunctionCalls(MCPRequest& request) {
     MCPResponse mcpResponse(200, request.id());
-    JsonVariantConst params = request.params();
 
-    if (!params.is<JsonObjectConst>() || !params["name"].is<const char*>()) {
+    if (!request.hasToolName) {
         return createJSONRPCError(200, static_cast<int>(ErrorCode::INVALID_PARAMS), request.id(),
                                   "Missing or invalid 'name' parameter");
     }
 
-    const char* functionName = params["name"].as<const char*>();
-    JsonVariantConst arguments = params["arguments"];
-    if (!arguments.isUnbound() && !arguments.is<JsonObjectConst>()) {
+    const char* functionName = request.name.c_str();
+    if (request.invalidArguments) {
         return createJSONRPCError(200, static_cast<int>(ErrorCode::INVALID_PARAMS), request.id(),
                                   "'arguments' must be an object");
     }
+    if (!request.argumentsProblem.empty()) {
+        return createJSONRPCError(200, static_cast<int>(ErrorCode::INVALID_PARAMS), request.id(),
+                                  "Invalid arguments: " + request.argumentsProblem);
+    }
 
-    // Resolve the handler under the lock, then release it before running user
-    // code of unknown duration.
+    /* Resolve the handler under the lock, then release it before running user
+     * code of unknown duration. A by-value one is copied out, which costs no
+     * allocation and no reference count; a replacement registered meanwhile
+     * cannot pull it from under the call either way. A lazy one is only
+     * looked up here and built below, outside the lock. */
     std::shared_ptr<ToolHandler> handler;
+    std::shared_ptr<LazyToolHandler> lazy;
+    ToolFunction function;
     {
         std::lock_guard<std::mutex> lock(toolsMutex);
-        // Short-string optimization keeps this key off the heap for normal names.
-        auto toolIt = tools.find(std::string(functionName));
-        if (toolIt == tools.end()) {
+        auto toolIt = tools.find(std::string_view(request.name));
+        const StaticTool* staticTool = toolIt == tools.end() ? findStaticTool(functionName) : nullptr;
+        if (toolIt == tools.end() && !staticTool) {
             /* Per MCP, an unknown tool is a -32602 invalid-params protocol error
              * ("Unknown tool: ..."), not -32601 — the method (tools/call) exists. */
             return createJSONRPCError(200, static_cast<int>(ErrorCode::INVALID_PARAMS), request.id(),
                                       std::string("Unknown tool: ") + functionName);
         }
-        if (!toolIt->second.handler) {
+        if (staticTool ? !staticTool->call
+                       : (!toolIt->second.handler && !toolIt->second.function && !toolIt->second.lazy)) {
             return createJSONRPCError(200, static_cast<int>(ErrorCode::INTERNAL_ERROR), request.id(),
                                       std::string("Tool handler not initialized: ") + functionName);
         }
-        handler = toolIt->second.handler;
+        if (staticTool) {
+            function = staticTool->call;
+        } else if (toolIt->second.function) {
+            function = toolIt->second.function;
+        } else if (toolIt->second.lazy) {
+            lazy = toolIt->second.lazy;
+        } else {
+            handler = toolIt->second.handler;
+        }
     }
 
-    JsonDocument argsDoc;
-    argsDoc.set(arguments);
+    JsonObject result = mcpResponse.resultDoc().to<JsonObject>();
 
+    ToolResultWriter* writer = nullptr;
     bool toolError = false;
-    JsonDocument resultDoc;
+    JsonDocument returned;    // a by-value handler's result
+    JsonVariantConst payload;  // the result, wherever it was built
     try {
-        resultDoc = handler->call(std::move(argsDoc), toolError);
+        if (lazy && !(handler = lazy->acquire())) {
+            return createJSONRPCError(200, static_cast<int>(ErrorCode::INTERNAL_ERROR), request.id(),
+                                      std::string("Tool handler not initialized: ") + functionName);
+        }
+        writer = handler ? handler->resultWriter() : nullptr;
+        if (function || writer) {
+            /* Built in place, in the slot it is sent from; the arguments are
+             * read where they were parsed. */
+            JsonObject structuredContent = result["structuredContent"].to<JsonObject>();
+            if (function) {
+                function(request.arguments(), structuredContent, toolError);
+            } else {
+                writer->call(request.arguments(), structuredContent, toolError);
+            }
+            payload = structuredContent;
+        } else if (MCPArena::Scope::allocator() == &s_heapAllocator) {
+            /* For tools/call, request.doc holds params.arguments and nothing
+             * else, so the handler's by-value document is the request's own,
+             * moved in: no copy, whatever the size of the arguments. Nothing
+             * reads them after this. */
+            returned = handler->call(std::move(request.doc), toolError);
+            payload = returned.as<JsonVariantConst>();
+        } else {
+            /* request.doc was built in the request's arena, in the scope still
+             * in effect. A handler owns its params and may keep them, and any
+             * copy it makes shares their allocator, so they must not outlive
+             * the reply: they are copied out to the heap first. */
+            JsonDocument arguments(&s_heapAllocator);
+            if (!arguments.set(request.doc.as<JsonVariantConst>())) {
+                return createJSONRPCError(200, static_cast<int>(ErrorCode::INTERNAL_ERROR), request.id(),
+                                          "Out of memory");
+            }
+            request.doc.clear();
+            returned = handler->call(std::move(arguments), toolError);
+            payload = returned.as<JsonVariantConst>();
+        }
     } catch (const std::exception& e) {
         return createJSONRPCError(200, static_cast<int>(ErrorCode::INTERNAL_ERROR), request.id(),
                                   std::string("Tool handler exception: ") + e.what());
@@ -969,14 +4055,11 @@ MCPResponse MCPServer::handleFunctionCalls(MCPRequest& request) {
                                   "Tool handler threw unknown exception");
     }
 
-    JsonObject result = mcpResponse.resultDoc.to<JsonObject>();
-    JsonArray content = result["content"].to<JsonArray>();
-
     /* structuredContent is defined by MCP as a JSON object, and an error
      * payload would not conform to a declared outputSchema — attach it only for
      * successful object results. Non-object results still reach the client as
      * serialized text content. */
-    const bool structured = !toolError && resultDoc.is<JsonObjectConst>();
+    const bool structured = !toolError && payload.is<JsonObjectConst>();
 
 #if defined(MCP_OMIT_TEXT_WHEN_STRUCTURED) && MCP_OMIT_TEXT_WHEN_STRUCTURED
     /* MCP only says a structured result SHOULD be mirrored as text, and
@@ -986,22 +4069,53 @@ MCPResponse MCPServer::handleFunctionCalls(MCPRequest& request) {
 #else
     const bool emitText = true;
 #endif
-    if (emitText) {
-        String resultText;
-        serializeJson(resultDoc, resultText);
-
-        JsonObject textContent = content.add<JsonObject>();
-        textContent["type"] = "text";
-        textContent["text"] = resultText;
+    /* The text itself is written by serializeResponse, straight from the
+     * payload; only where to find it is recorded here. A text-only result is
+     * nothing but its payload, so the payload becomes the reply's document. */
+    mcpResponse.toolError = toolError;
+    if (!structured) {
+        if (function || writer) {
+            /* A payload built in place is sent as text only, so it is copied out
+             * of structuredContent. Error path; the copy is fine. */
+            JsonDocument text(MCPArena::Scope::allocator());
+            text.set(payload);
+            mcpResponse.resultDoc() = std::move(text);
+        } else {
+            mcpResponse.resultDoc() = std::move(returned);
+        }
+        mcpResponse.textSource = MCPResponse::TextSource::PAYLOAD;
+        return mcpResponse;
+    }
+    if (!function && !writer) {
+        result["structuredContent"].set(payload);
     }
-    if (structured) {
-        result["structuredContent"].set(resultDoc.as<JsonVariantConst>());
+    if (emitText) {
+        mcpResponse.textSource = MCPResponse::TextSource::STRUCTURED;
+    } else {
+        result["content"].to<JsonArray>();
     }
     result["isError"] = toolError;
 
     return mcpResponse;
 }
 
+void MCPServer::evictIdleHandlers() {
+    /* Destroyed only once toolsMutex is released: a handler's destructor may
+     * be as slow as its constructor was. */
+    std::vector<std::shared_ptr<ToolHandler>> idle;
+    const unsigned long now = millis();
+    {
+        std::lock_guard<std::mutex> lock(toolsMutex);
+        for (auto& entry : tools) {
+            if (entry.second.lazy) {
+                if (auto handler = entry.second.lazy->takeIfIdle(now)) {
+                    idle.push_back(std::move(handler));
+                }
+            }
+        }
+    }
+}
+
 bool MCPServer::isSupportedProtocolVersion(const char* version) const {
     if (!version) {
         return false;
@@ -1019,12 +4133,13 @@ const char* MCPServer::negotiateProtocolVersion(JsonVariantConst params) const {
     return PROTOCOL_VERSION;
 }
 
-MCPResponse MCPServer::createJSONRPCError(int httpCode, int rpcCode, const JsonVariantConst& id,
+MCPResponse MCPServer::createJSONRPCError(int httpCode, int rpcCode, const MCPId& id,
                                           const std::string& message) {
     MCPResponse response(httpCode, id);
 
-    response.errorDoc["code"] = rpcCode;
-    response.errorDoc["message"] = message;
+    JsonDocument& error = response.errorDoc();
+    error["code"] = rpcCode;
+    error["message"] = message;
 
     return response;
 }
@@ -2,6 +2,7 @@
 
 #include "WString.h"
 
+#include <atomic>
 #include <cstdio>
 #include <cstdint>
 #include <cstdarg>
@@ -15,3 +16,10 @@ public:
 };
 
 inline HardwareSerial Serial;
+
+// The clock millis() reads; tests advance it by hand.
+namespace mock_arduino {
+inline std::atomic<unsigned long> now{0};
+}
+
+inline unsigned long millis() { return mock_arduino::now.load(); }
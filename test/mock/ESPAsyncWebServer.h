@@ -5,7 +5,9 @@
  * Faithful where it matters to HttpMCPServer:
  *  - _tempObject is released with free() in the request destructor, exactly
  *    like the real library — so an aborted upload exercises the same teardown
- *    path (a C++ object stored there would leak / corrupt the heap).
+ *    path (a C++ object stored there would leak / corrupt the heap). The
+ *    onDisconnect callback runs first, as _onDisconnect does before deleting
+ *    the request.
  *  - Header lookup is case-insensitive.
  *  - The MCP endpoint is registered as an AsyncWebHandler that matches on path
  *    alone (the real library would refuse a server->on() route for any request
@@ -19,10 +21,16 @@
  *    returning RESPONSE_TRY_AGAIN sends nothing that round. The response
  *    object — and the filler lambda with its captures — is destroyed on
  *    completion (like _onAck) or with the request (like a disconnect).
+ *  - An AsyncAbstractResponse subclass is drained through _fillBuffer() in
+ *    TCP-window-sized pieces as soon as it is sent, the way _ack() pulls it.
+ *
+ * mock_async_web::heapProbe() lets a test count large operator-new
+ * allocations on any thread; the mock's own bookkeeping copies are excluded.
  */
 
 #include "WString.h"
 
+#include <atomic>
 #include <cctype>
 #include <cstdint>
 #include <cstdlib>
@@ -50,9 +58,36 @@ enum WebRequestMethod : int {
 #define RESPONSE_TRY_AGAIN 0xFFFFFFFF
 
 using AwsResponseFiller = std::function<size_t(uint8_t*, size_t, size_t)>;
+using ArDisconnectHandler = std::function<void(void)>;
 
 class AsyncWebServerRequest;
 
+namespace mock_async_web {
+/* Counts allocations of at least minSize bytes while armed. The test binary
+ * provides the operator new that feeds it; code running under a
+ * HeapProbePause on the same thread is not counted. */
+struct HeapProbe {
+    std::atomic<size_t> minSize{SIZE_MAX};
+    std::atomic<int> hits{0};
+};
+
+inline HeapProbe& heapProbe() {
+    static HeapProbe probe;
+    return probe;
+}
+
+inline bool& heapProbePaused() {
+    static thread_local bool paused = false;
+    return paused;
+}
+
+struct HeapProbePause {
+    HeapProbePause() : previous(heapProbePaused()) { heapProbePaused() = true; }
+    ~HeapProbePause() { heapProbePaused() = previous; }
+    bool previous;
+};
+}  // namespace mock_async_web
+
 class AsyncWebHeader {
 public:
     explicit AsyncWebHeader(const char* value) : value_(value) {}
@@ -71,17 +106,38 @@ public:
     AsyncWebServerResponse(const String& contentType, AwsResponseFiller filler)
         : code(200), contentType(contentType.c_str()), filler(std::move(filler)) {}
 
+    virtual ~AsyncWebServerResponse() = default;
+
     void addHeader(const String& name, const String& value) {
         headers[name.c_str()] = value.c_str();
     }
 
+    void setCode(int value) { code = value; }
+    void setContentType(const char* type) { contentType = type; }
+    void setContentLength(size_t len) { contentLength = len; }
+
+    // AsyncAbstractResponse's source interface; the plain response has none.
+    virtual bool _sourceValid() const { return false; }
+    virtual size_t _fillBuffer(uint8_t* buf, size_t maxLen) {
+        (void)buf;
+        (void)maxLen;
+        return 0;
+    }
+
     int code;
     std::string contentType;
     std::string body;
+    size_t contentLength = 0;
     std::map<std::string, std::string> headers;
     AwsResponseFiller filler;  // non-empty => chunked/deferred
+
+protected:
+    AsyncWebServerResponse() : code(200) {}
 };
 
+// Base for responses that produce their own bytes through _fillBuffer().
+class AsyncAbstractResponse : public AsyncWebServerResponse {};
+
 class AsyncWebServerRequest {
 public:
     AsyncWebServerRequest() = default;
@@ -92,6 +148,9 @@ public:
         /* Mirrors ~AsyncWebServerRequest in the real library: _tempObject is
          * released with free(), destructors are NOT run, and a still-pending
          * response is deleted with the request (the disconnect path). */
+        if (_onDisconnect) {
+            _onDisconnect();
+        }
         if (_tempObject) {
             free(_tempObject);
             _tempObject = nullptr;
@@ -142,6 +201,21 @@ public:
     }
 
     void send(AsyncWebServerResponse* response) {
+        mock_async_web::HeapProbePause pause;
+        if (response->_sourceValid()) {
+            std::string body;
+            uint8_t buffer[512];
+            while (body.size() < response->contentLength) {
+                size_t got = response->_fillBuffer(buffer, sizeof(buffer));
+                if (got == 0) {
+                    break;
+                }
+                body.append(reinterpret_cast<char*>(buffer), got);
+            }
+            record(response->code, response->contentType, std::move(body), response->headers);
+            delete response;
+            return;
+        }
         if (response->filler) {
             /* Deferred: content arrives through the filler; tests pull it with
              * pumpChunked(). Nothing is recorded until the terminating chunk. */
@@ -158,6 +232,7 @@ public:
      * response completes, is recorded, and is destroyed like in _onAck).
      * Returns true once the response has completed. */
     bool pumpChunked(size_t maxLen = 512) {
+        mock_async_web::HeapProbePause pause;
         if (!_pendingResponse) {
             return responseCount > 0;
         }
@@ -180,8 +255,13 @@ public:
         return false;
     }
 
+    void onDisconnect(ArDisconnectHandler fn) { _onDisconnect = std::move(fn); }
+
     bool hasPendingResponse() const { return _pendingResponse != nullptr; }
 
+    // Bytes the pending chunked response has produced so far.
+    size_t chunkedBytes() const { return _chunkIndex; }
+
     void* _tempObject = nullptr;
 
     /* ---- test-side setup & inspection ---- */
@@ -234,6 +314,7 @@ private:
     bool eventStreamAccept_ = false;
     String contentType_ = String("application/json");
     AsyncWebServerResponse* _pendingResponse = nullptr;
+    ArDisconnectHandler _onDisconnect;
     std::string _chunkBody;
     size_t _chunkIndex = 0;
 };
@@ -0,0 +1,97 @@
+#pragma once
+
+/* Two-heap stand-in for ESP-IDF's capability allocator, as on a WROVER-class
+ * board: internal RAM plus PSRAM. Both are the process heap underneath, so
+ * free() and realloc() work on every block the way they do on the device. What
+ * the mock adds is a tally of the sizes each region was asked for.
+ * setSpiramAvailable(false) models a board without PSRAM, where a
+ * MALLOC_CAP_SPIRAM request returns null. */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+namespace mock_heap_caps {
+
+struct Region {
+    std::atomic<size_t> allocations{0};
+    std::atomic<size_t> smallest{SIZE_MAX};
+    std::atomic<size_t> largest{0};
+
+    void record(size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        size_t seen = smallest.load(std::memory_order_relaxed);
+        while (size < seen && !smallest.compare_exchange_weak(seen, size, std::memory_order_relaxed)) {
+        }
+        seen = largest.load(std::memory_order_relaxed);
+        while (size > seen && !largest.compare_exchange_weak(seen, size, std::memory_order_relaxed)) {
+        }
+    }
+
+    void reset() {
+        allocations.store(0, std::memory_order_relaxed);
+        smallest.store(SIZE_MAX, std::memory_order_relaxed);
+        largest.store(0, std::memory_order_relaxed);
+    }
+};
+
+inline Region& internal() {
+    static Region region;
+    return region;
+}
+
+inline Region& spiram() {
+    static Region region;
+    return region;
+}
+
+inline std::atomic<bool>& spiramPresent() {
+    static std::atomic<bool> present{true};
+    return present;
+}
+
+inline void setSpiramAvailable(bool available) {
+    spiramPresent().store(available, std::memory_order_relaxed);
+}
+
+inline void reset() {
+    internal().reset();
+    spiram().reset();
+}
+
+// The region a request with `caps` is served from, or null if there is none.
+inline Region* regionFor(uint32_t caps) {
+    if (caps & MALLOC_CAP_SPIRAM) {
+        return spiramPresent().load(std::memory_order_relaxed) ? &spiram() : nullptr;
+    }
+    return &internal();
+}
+
+}  // namespace mock_heap_caps
+
+inline void* heap_caps_malloc(size_t size, uint32_t caps) {
+    mock_heap_caps::Region* region = mock_heap_caps::regionFor(caps);
+    if (!region) {
+        return nullptr;
+    }
+    region->record(size);
+    return malloc(size ? size : 1);
+}
+
+inline void* heap_caps_realloc(void* ptr, size_t size, uint32_t caps) {
+    mock_heap_caps::Region* region = mock_heap_caps::regionFor(caps);
+    if (!region) {
+        return nullptr;
+    }
+    region->record(size);
+    return realloc(ptr, size ? size : 1);
+}
+
+inline void heap_caps_free(void* ptr) {
+    free(ptr);
+}
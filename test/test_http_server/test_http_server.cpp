@@ -2,13 +2,39 @@
 
 #include <atomic>
 #include <chrono>
+#include <cstdlib>
 #include <cstring>
 #include <memory>
+#include <new>
 #include <string>
 #include <thread>
 
+#include <esp_heap_caps.h>
+
 #include "MCPServer.h"
 
+/* Global operator new feeds the mock's heap probe, so a test can count the
+ * large allocations made on its behalf — on the worker task too. */
+void* operator new(size_t size) {
+    mock_async_web::HeapProbe& probe = mock_async_web::heapProbe();
+    if (size >= probe.minSize.load(std::memory_order_relaxed) && !mock_async_web::heapProbePaused()) {
+        probe.hits.fetch_add(1, std::memory_order_relaxed);
+    }
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
 /* Drives the handlers MCPServer registers on the mock AsyncWebServer the
  * way the real library does: body callback per chunk, then the onRequest
  * callback once the request is complete. tools/call answers arrive through a
@@ -45,6 +71,31 @@ public:
     }
 };
 
+/* Gated like GateHandler, then answers with a result that needs every kind
+ * of escaping once it is nested into the text content. */
+class BulkHandler : public ToolHandler {
+public:
+    JsonDocument call(JsonDocument params) override {
+        (void)params;
+        while (!g_gate_open.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        JsonDocument result;
+        result["quote"] = "say \"hi\" \\ back\n\ttab\x01";
+        result["flag"] = true;
+        result["nothing"] = nullptr;
+        result["ratio"] = 0.5;
+        JsonArray rows = result["rows"].to<JsonArray>();
+        for (int i = 0; i < 64; ++i) {
+            JsonObject row = rows.add<JsonObject>();
+            row["n"] = i;
+            row["label"] = std::string(static_cast<size_t>(i % 9), '"');
+            row["tags"].to<JsonArray>().add("a\\b");
+        }
+        return result;
+    }
+};
+
 struct TestServer {
     TestServer() : mcp(3000, "test-http", "1.0.0") {
         Tool tool;
@@ -61,6 +112,13 @@ struct TestServer {
         gate.handler = std::make_shared<GateHandler>();
         mcp.RegisterTool(gate);
 
+        Tool bulk;
+        bulk.name = "bulk";
+        bulk.description = "Gated, with a large escape-heavy result";
+        bulk.inputSchema = Schema::object().build();
+        bulk.handler = std::make_shared<BulkHandler>();
+        mcp.RegisterTool(bulk);
+
         TEST_ASSERT_TRUE(mcp.begin());
         web = mock_async_web::lastServer();
     }
@@ -91,14 +149,20 @@ void drivePost(TestServer& srv, AsyncWebServerRequest& req, const std::string& b
     route->onRequest(&req);
 }
 
-bool pumpUntilComplete(AsyncWebServerRequest& req, int timeoutMs = 2000) {
-    for (int waited = 0; waited <= timeoutMs; waited += 5) {
-        if (req.pumpChunked()) {
+/* Only a round that sent nothing waits for the next poll, so a reply pulled
+ * through a small maxLen does not spend the timeout on its own length. */
+bool pumpUntilComplete(AsyncWebServerRequest& req, int timeoutMs = 2000, size_t maxLen = 512) {
+    for (int waited = 0; waited <= timeoutMs;) {
+        size_t before = req.chunkedBytes();
+        if (req.pumpChunked(maxLen)) {
             return true;
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        if (req.chunkedBytes() == before) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            waited += 5;
+        }
     }
-    return req.pumpChunked();
+    return req.pumpChunked(maxLen);
 }
 
 bool waitForFlag(std::atomic<bool>& flag, int timeoutMs = 2000) {
@@ -154,6 +218,73 @@ void test_fast_tool_call_answers_inline(void) {
     TEST_ASSERT_EQUAL_STRING("2025-11-25", req.lastHeaders["MCP-Protocol-Version"].c_str());
 }
 
+void test_inline_tool_reply_is_never_built_as_a_string(void) {
+    /* The reply is measured, then streamed from the result tree into the
+     * response: no body-sized allocation at all, where growing a string and
+     * copying it into a String took several. */
+    TestServer srv;
+    const std::string text(4000, 'x');
+    const std::string body =
+        R"({"jsonrpc":"2.0","id":3,"method":"tools/call","params":{"name":"echo","arguments":{"text":")" + text +
+        R"("}}})";
+
+    AsyncWebServerRequest req;
+    mock_async_web::HeapProbe& probe = mock_async_web::heapProbe();
+    probe.hits.store(0);
+    probe.minSize.store(text.size());
+    drivePost(srv, req, body);
+    probe.minSize.store(SIZE_MAX);
+
+    TEST_ASSERT_EQUAL_INT(1, req.responseCount);
+    TEST_ASSERT_FALSE(req.hasPendingResponse());
+    TEST_ASSERT_EQUAL_INT(0, probe.hits.load());
+
+    JsonDocument reply;
+    TEST_ASSERT_TRUE(deserializeJson(reply, req.lastBody) == DeserializationError::Ok);
+    TEST_ASSERT_EQUAL_INT(3, reply["id"].as<int>());
+    TEST_ASSERT_TRUE(text == reply["result"]["structuredContent"]["echo"].as<const char*>());
+    TEST_ASSERT_EQUAL_STRING("2025-11-25", req.lastHeaders["MCP-Protocol-Version"].c_str());
+}
+
+void test_tools_list_is_sent_from_the_shared_cache(void) {
+    /* Once the cache is built, a tools/list reply writes only its envelope:
+     * the list goes from the shared buffer into the response a fill at a
+     * time, so no catalog-sized buffer is allocated for it. */
+    TestServer srv;
+    const std::string description(6000, 'd');
+    Tool large;
+    large.name = "large";
+    large.description = description.c_str();
+    large.inputSchema = Schema::object().build();
+    large.handler = std::make_shared<EchoHandler>();
+    srv.mcp.RegisterTool(large);
+
+    AsyncWebServerRequest warm;
+    drivePost(srv, warm, R"({"jsonrpc":"2.0","id":1,"method":"tools/list"})");
+    TEST_ASSERT_EQUAL_INT(200, warm.lastCode);
+
+    AsyncWebServerRequest req;
+    mock_heap_caps::reset();
+    mock_async_web::HeapProbe& probe = mock_async_web::heapProbe();
+    probe.hits.store(0);
+    probe.minSize.store(description.size());
+    drivePost(srv, req, R"({"jsonrpc":"2.0","id":"second","method":"tools/list"})");
+    probe.minSize.store(SIZE_MAX);
+
+    TEST_ASSERT_EQUAL_INT(0, probe.hits.load());
+    TEST_ASSERT_LESS_THAN(description.size(), mock_heap_caps::internal().largest.load());
+    TEST_ASSERT_EQUAL(0, mock_heap_caps::spiram().allocations.load());
+
+    JsonDocument reply;
+    TEST_ASSERT_TRUE(deserializeJson(reply, req.lastBody) == DeserializationError::Ok);
+    TEST_ASSERT_EQUAL_STRING("second", reply["id"].as<const char*>());
+    TEST_ASSERT_EQUAL_INT(4, reply["result"]["tools"].size());
+    TEST_ASSERT_TRUE(description == reply["result"]["tools"][3]["description"].as<const char*>());
+    TEST_ASSERT_EQUAL_STRING(warm.lastBody.substr(warm.lastBody.find("\"result\"")).c_str(),
+                             req.lastBody.substr(req.lastBody.find("\"result\"")).c_str());
+    TEST_ASSERT_EQUAL_STRING("2025-11-25", req.lastHeaders["MCP-Protocol-Version"].c_str());
+}
+
 void test_slow_tool_call_falls_back_to_chunked_body(void) {
     /* Past the fast-path window the reply must still go out deferred: nothing
      * inline, body delivered by the chunked filler once the handler returns. */
@@ -174,6 +305,104 @@ void test_slow_tool_call_falls_back_to_chunked_body(void) {
     TEST_ASSERT_EQUAL_STRING("2025-11-25", req.lastHeaders["MCP-Protocol-Version"].c_str());
 }
 
+void test_deferred_reply_streams_across_small_fills(void) {
+    /* The chunked filler serializes on demand and stops wherever the buffer
+     * fills — mid-string, mid-escape, between a key and its value. Pulling
+     * seven bytes at a time has to reassemble into the same reply. */
+    TestServer srv;
+    AsyncWebServerRequest req;
+    drivePost(srv, req, R"({"jsonrpc":"2.0","id":8,"method":"tools/call","params":{"name":"bulk","arguments":{}}})");
+    TEST_ASSERT_TRUE(req.hasPendingResponse());
+
+    g_gate_open.store(true);
+    TEST_ASSERT_TRUE(pumpUntilComplete(req, 2000, 7));
+    TEST_ASSERT_EQUAL_INT(200, req.lastCode);
+
+    JsonDocument reply;
+    TEST_ASSERT_TRUE(deserializeJson(reply, req.lastBody) == DeserializationError::Ok);
+    TEST_ASSERT_EQUAL_INT(8, reply["id"].as<int>());
+    JsonVariantConst structured = reply["result"]["structuredContent"];
+    TEST_ASSERT_EQUAL_STRING("say \"hi\" \\ back\n\ttab\x01", structured["quote"].as<const char*>());
+    TEST_ASSERT_TRUE(structured["nothing"].isNull());
+    TEST_ASSERT_EQUAL_INT(64, structured["rows"].size());
+    TEST_ASSERT_EQUAL_STRING("\"\"\"", structured["rows"][12]["label"].as<const char*>());
+    TEST_ASSERT_EQUAL_STRING("a\\b", structured["rows"][63]["tags"][0].as<const char*>());
+
+    // The text content is the same result, serialized and escaped once more.
+    JsonDocument text;
+    TEST_ASSERT_TRUE(deserializeJson(text, reply["result"]["content"][0]["text"].as<const char*>()) ==
+                     DeserializationError::Ok);
+    std::string fromText;
+    std::string fromStructured;
+    serializeJson(text, fromText);
+    serializeJson(structured, fromStructured);
+    TEST_ASSERT_EQUAL_STRING(fromStructured.c_str(), fromText.c_str());
+}
+
+void test_streamed_reply_matches_arduinojson(void) {
+    /* The stream escapes on its own, in two levels for the text content. Fed
+     * fuzzed strings through echo, its reply has to be exactly what
+     * ArduinoJson writes for the same result. NUL is left out: it could not
+     * survive the request's own parse. */
+    TestServer srv;
+    uint32_t state = 0x9E3779B9u;
+    auto next = [&state]() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+    for (int id = 1; id <= 60; ++id) {
+        std::string text;
+        size_t length = next() % 4 == 0 ? 300 + next() % 1200 : next() % 48;
+        for (size_t i = 0; i < length; ++i) {
+            uint32_t r = next() % 16;
+            if (r == 0) {
+                text += '"';
+            } else if (r == 1) {
+                text += '\\';
+            } else if (r == 2) {
+                text += static_cast<char>(1 + next() % 0x1F);
+            } else if (r == 3) {
+                text += static_cast<char>(0x80 + next() % 0x80);
+            } else {
+                text += static_cast<char>(0x20 + next() % 0x5F);
+            }
+        }
+
+        JsonDocument call;
+        call["jsonrpc"] = "2.0";
+        call["id"] = id;
+        call["method"] = "tools/call";
+        call["params"]["name"] = "echo";
+        call["params"]["arguments"]["text"] = text;
+        std::string body;
+        serializeJson(call, body);
+
+        JsonDocument structured;
+        structured["echo"] = text;
+        std::string inner;
+        serializeJson(structured, inner);
+        JsonDocument expected;
+        expected["jsonrpc"] = "2.0";
+        expected["id"] = id;
+        JsonObject result = expected["result"].to<JsonObject>();
+        JsonObject item = result["content"].to<JsonArray>().add<JsonObject>();
+        item["type"] = "text";
+        item["text"] = inner;
+        result["structuredContent"] = structured;
+        result["isError"] = false;
+        std::string want;
+        serializeJson(expected, want);
+
+        AsyncWebServerRequest req;
+        drivePost(srv, req, body);
+        TEST_ASSERT_TRUE(pumpUntilComplete(req, 2000, 1 + id % 13));
+        TEST_ASSERT_EQUAL_size_t(want.size(), req.lastBody.size());
+        TEST_ASSERT_TRUE(want == req.lastBody);
+    }
+}
+
 void test_tool_call_notification_stays_inline_202(void) {
     /* A tools/call without an id is a notification: no execution, no body,
      * answered 202 inline — it must not occupy the worker queue. */
@@ -247,6 +476,68 @@ void test_slow_tool_does_not_block_other_requests(void) {
     TEST_ASSERT_NOT_NULL(strstr(slowReq.lastBody.c_str(), "\"id\":5"));
 }
 
+void test_queued_tool_call_takes_its_body_to_the_worker(void) {
+    /* The arguments of a queued call are parsed by the worker, not on the
+     * request path, so the raw body has to outlive handlePostComplete. It
+     * leaves _tempObject with the job; under native-san, freeing it early
+     * would show up as a use-after-free once the worker gets to it. */
+    TestServer srv;
+    AsyncWebServerRequest slowReq;
+    drivePost(srv, slowReq, kGateCall);
+    TEST_ASSERT_TRUE(waitForFlag(g_gate_entered));
+
+    const std::string text(MCP_HTTP_MAX_BODY_SIZE - 256, 't');
+    AsyncWebServerRequest echoReq;
+    drivePost(srv, echoReq,
+              R"({"jsonrpc":"2.0","id":7,"method":"tools/call","params":{"name":"echo","arguments":{"text":")" +
+                  text + R"("}}})");
+    TEST_ASSERT_NULL(echoReq._tempObject);
+    TEST_ASSERT_TRUE(echoReq.hasPendingResponse());
+
+    g_gate_open.store(true);
+    TEST_ASSERT_TRUE(pumpUntilComplete(slowReq));
+    TEST_ASSERT_TRUE(pumpUntilComplete(echoReq));
+    TEST_ASSERT_EQUAL_INT(200, echoReq.lastCode);
+    TEST_ASSERT_NOT_NULL(strstr(echoReq.lastBody.c_str(), "\"id\":7"));
+    TEST_ASSERT_NOT_NULL(strstr(echoReq.lastBody.c_str(), text.c_str()));
+}
+
+void test_invalid_arguments_are_rejected_without_reaching_the_worker(void) {
+    /* With the worker held in a handler, a call that its schema rejects is
+     * still answered at once: it is checked before anything is queued. */
+    TestServer srv;
+    Tool typed;
+    typed.name = "typed";
+    typed.description = "Requires a string";
+    typed.inputSchema = Schema::object().property("text", Schema::string()).required({"text"}).build();
+    typed.handler = std::make_shared<EchoHandler>();
+    srv.mcp.RegisterTool(typed);
+
+    AsyncWebServerRequest slowReq;
+    drivePost(srv, slowReq, kGateCall);
+    TEST_ASSERT_TRUE(waitForFlag(g_gate_entered));
+
+    AsyncWebServerRequest badReq;
+    drivePost(srv, badReq,
+              R"({"jsonrpc":"2.0","id":8,"method":"tools/call","params":{"name":"typed","arguments":{"text":1}}})");
+    TEST_ASSERT_EQUAL_INT(1, badReq.responseCount);
+    TEST_ASSERT_FALSE(badReq.hasPendingResponse());
+    TEST_ASSERT_NULL(badReq._tempObject);
+    TEST_ASSERT_EQUAL_INT(200, badReq.lastCode);
+    TEST_ASSERT_NOT_NULL(strstr(badReq.lastBody.c_str(), "-32602"));
+    TEST_ASSERT_NOT_NULL(strstr(badReq.lastBody.c_str(), "'text' must be of type string"));
+    TEST_ASSERT_NOT_NULL(strstr(badReq.lastBody.c_str(), "\"id\":8"));
+
+    g_gate_open.store(true);
+    TEST_ASSERT_TRUE(pumpUntilComplete(slowReq));
+
+    AsyncWebServerRequest goodReq;
+    drivePost(srv, goodReq,
+              R"({"jsonrpc":"2.0","id":9,"method":"tools/call","params":{"name":"typed","arguments":{"text":"ok"}}})");
+    TEST_ASSERT_TRUE(pumpUntilComplete(goodReq));
+    TEST_ASSERT_NOT_NULL(strstr(goodReq.lastBody.c_str(), "\"ok\""));
+}
+
 void test_tool_call_queue_full_gets_busy_error(void) {
     TestServer srv;
     AsyncWebServerRequest gateReq;
@@ -456,9 +747,10 @@ void test_server_does_not_listen_until_begin(void) {
 
 void test_aborted_upload_is_reclaimed_by_free(void) {
     /* The request dies mid-upload: onRequest never runs and the destructor
-     * releases _tempObject with free(), as the real library does. The buffer
-     * must be a plain malloc block for that to be leak- and corruption-free
-     * (a String stored there used to leak its heap buffer). */
+     * releases _tempObject with free(), as the real library does. A pooled
+     * buffer must be handed back by the disconnect callback before that, and a
+     * heap one must be a plain malloc block, for either to be leak- and
+     * corruption-free (a String stored there used to leak its heap buffer). */
     TestServer srv;
     {
         AsyncWebServerRequest req;
@@ -471,6 +763,78 @@ void test_aborted_upload_is_reclaimed_by_free(void) {
     TEST_ASSERT_TRUE(true);  // reaching here without ASAN/heap errors is the assertion
 }
 
+void test_aborted_upload_returns_its_pool_slot(void) {
+    /* Every upload takes the lowest free body slot. If an abort kept its slot,
+     * the next upload would get another one, and once the pool ran dry, the
+     * heap. */
+    TestServer srv;
+    const AsyncWebServer::Route* route = srv.postRoute();
+    std::string chunk(512, 'A');
+    void* slot = nullptr;
+    for (int i = 0; i < MCP_HTTP_BODY_POOL_SLOTS + 2; ++i) {
+        AsyncWebServerRequest req;
+        req.setContentLength(4096);
+        route->onBody(&req, reinterpret_cast<uint8_t*>(chunk.data()), chunk.size(), 0, 4096);
+        TEST_ASSERT_NOT_NULL(req._tempObject);
+        if (i == 0) {
+            slot = req._tempObject;
+        }
+        TEST_ASSERT_EQUAL_PTR(slot, req._tempObject);
+    }
+}
+
+void test_uploads_beyond_the_body_pool_fall_back_to_the_heap(void) {
+    /* More bodies in flight than the pool has slots: the extra ones are
+     * buffered on the heap, and every request is still answered. */
+    TestServer srv;
+    const AsyncWebServer::Route* route = srv.postRoute();
+    const int kUploads = MCP_HTTP_BODY_POOL_SLOTS + 2;
+    AsyncWebServerRequest reqs[kUploads];
+    std::string bodies[kUploads];
+    for (int i = 0; i < kUploads; ++i) {
+        bodies[i] = R"({"jsonrpc":"2.0","id":)" + std::to_string(100 + i) +
+                    R"(,"method":"tools/call","params":{"name":"echo","arguments":{"text":"upload )" +
+                    std::to_string(i) + R"("}}})";
+        reqs[i].setContentLength(bodies[i].size());
+        route->onBody(&reqs[i], reinterpret_cast<uint8_t*>(&bodies[i][0]), 10, 0, bodies[i].size());
+        TEST_ASSERT_NOT_NULL(reqs[i]._tempObject);
+    }
+    for (int i = 0; i < kUploads; ++i) {
+        route->onBody(&reqs[i], reinterpret_cast<uint8_t*>(&bodies[i][10]), bodies[i].size() - 10, 10,
+                      bodies[i].size());
+        route->onRequest(&reqs[i]);
+        TEST_ASSERT_TRUE(reqs[i].responseCount > 0 || pumpUntilComplete(reqs[i]));
+        TEST_ASSERT_EQUAL_INT(200, reqs[i].lastCode);
+        const std::string expected = "\"id\":" + std::to_string(100 + i);
+        TEST_ASSERT_NOT_NULL(strstr(reqs[i].lastBody.c_str(), expected.c_str()));
+        const std::string text = "upload " + std::to_string(i);
+        TEST_ASSERT_NOT_NULL(strstr(reqs[i].lastBody.c_str(), text.c_str()));
+    }
+}
+
+void test_body_pool_is_reserved_in_psram(void) {
+    /* The body slots are far over the threshold, so begin() reserves them in
+     * PSRAM. Without PSRAM they come from internal RAM and requests are served
+     * the same way. */
+    for (bool psram : {true, false}) {
+        mock_heap_caps::setSpiramAvailable(psram);
+        mock_heap_caps::reset();
+        TestServer srv;
+        if (psram) {
+            TEST_ASSERT_GREATER_OR_EQUAL(1, mock_heap_caps::spiram().allocations.load());
+            TEST_ASSERT_GREATER_THAN(MCP_HTTP_MAX_BODY_SIZE, mock_heap_caps::spiram().largest.load());
+        } else {
+            TEST_ASSERT_EQUAL(0, mock_heap_caps::spiram().allocations.load());
+            TEST_ASSERT_GREATER_THAN(MCP_HTTP_MAX_BODY_SIZE, mock_heap_caps::internal().largest.load());
+        }
+
+        AsyncWebServerRequest req;
+        drivePost(srv, req, R"({"jsonrpc":"2.0","id":1,"method":"ping"})");
+        TEST_ASSERT_EQUAL_INT(200, req.lastCode);
+    }
+    mock_heap_caps::setSpiramAvailable(true);
+}
+
 void test_protocol_version_2025_06_18_header_is_accepted(void) {
     TestServer srv;
     AsyncWebServerRequest req;
@@ -489,6 +853,8 @@ void test_unsupported_protocol_version_header_is_rejected(void) {
 
     TEST_ASSERT_EQUAL_INT(400, req.lastCode);
     TEST_ASSERT_NOT_NULL(strstr(req.lastBody.c_str(), "-32602"));
+    // Rejected from the envelope scan, which still recovers the id.
+    TEST_ASSERT_NOT_NULL(strstr(req.lastBody.c_str(), "\"id\":1"));
 }
 
 void test_legacy_http_sse_protocol_version_header_is_rejected(void) {
@@ -681,11 +1047,17 @@ int main(int argc, char** argv) {
     UNITY_BEGIN();
     RUN_TEST(test_tools_list_roundtrip);
     RUN_TEST(test_fast_tool_call_answers_inline);
+    RUN_TEST(test_inline_tool_reply_is_never_built_as_a_string);
+    RUN_TEST(test_tools_list_is_sent_from_the_shared_cache);
     RUN_TEST(test_slow_tool_call_falls_back_to_chunked_body);
+    RUN_TEST(test_deferred_reply_streams_across_small_fills);
+    RUN_TEST(test_streamed_reply_matches_arduinojson);
     RUN_TEST(test_tool_call_notification_stays_inline_202);
     RUN_TEST(test_http_1_0_tool_call_is_rejected_without_chunk_framing);
     RUN_TEST(test_tool_call_job_alloc_failure_returns_500_not_abort);
     RUN_TEST(test_slow_tool_does_not_block_other_requests);
+    RUN_TEST(test_queued_tool_call_takes_its_body_to_the_worker);
+    RUN_TEST(test_invalid_arguments_are_rejected_without_reaching_the_worker);
     RUN_TEST(test_tool_call_queue_full_gets_busy_error);
     RUN_TEST(test_client_abort_discards_result_without_crash);
     RUN_TEST(test_server_teardown_with_inflight_job);
@@ -698,6 +1070,9 @@ int main(int argc, char** argv) {
     RUN_TEST(test_non_json_content_type_with_body_gets_415);
     RUN_TEST(test_server_does_not_listen_until_begin);
     RUN_TEST(test_aborted_upload_is_reclaimed_by_free);
+    RUN_TEST(test_aborted_upload_returns_its_pool_slot);
+    RUN_TEST(test_uploads_beyond_the_body_pool_fall_back_to_the_heap);
+    RUN_TEST(test_body_pool_is_reserved_in_psram);
     RUN_TEST(test_protocol_version_2025_06_18_header_is_accepted);
     RUN_TEST(test_unsupported_protocol_version_header_is_rejected);
     RUN_TEST(test_legacy_http_sse_protocol_version_header_is_rejected);
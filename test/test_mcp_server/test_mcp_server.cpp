@@ -1,6 +1,14 @@
 #include <unity.h>
 #include <ArduinoJson.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <esp_heap_caps.h>
+#include <thread>
+
 #include "MCPServer.h"
 
 /* ======== Test Helpers ======== */
@@ -15,11 +23,16 @@ public:
         : MCPServer(0, name, version, instructions) {}
 
     using MCPServer::parseRequest;
+    using MCPServer::scanRequest;
+    using MCPServer::materializeRequest;
     using MCPServer::serializeResponse;
     using MCPServer::handle;
     using MCPServer::createJSONRPCError;
     using MCPServer::tools;
     using MCPServer::toolsListJson;
+    using MCPServer::inputSchemaOf;
+    using MCPServer::checkArguments;
+    using MCPServer::evictIdleHandlers;
 };
 
 /* tools/list answers from a pre-serialized cache rather than a JsonDocument, so
@@ -31,6 +44,14 @@ static void parseResponseBody(TestMCPServer* server, const MCPResponse& res, Jso
     TEST_ASSERT_FALSE(err);
 }
 
+/* A tools/call result's text content is written by serializeResponse straight
+ * from the payload and exists only on the wire, so tool results are read back
+ * the same way. */
+static JsonVariantConst toolResult(TestMCPServer* server, const MCPResponse& res, JsonDocument& body) {
+    parseResponseBody(server, res, body);
+    return body["result"];
+}
+
 /* Reads a tool's payload out of a result whichever way it was carried, so tests
  * about the payload itself stay valid under MCP_OMIT_TEXT_WHEN_STRUCTURED.
  * Tests specifically about the text/structured split assert on the raw result
@@ -104,6 +125,43 @@ public:
     }
 };
 
+class EchoWriter : public ToolResultWriter {
+public:
+    void call(JsonVariantConst arguments, JsonObject result, bool& isError) override {
+        result["echo"] = arguments["message"];
+        if (arguments["fail"].as<bool>()) {
+            isError = true;
+        }
+    }
+};
+
+/* Records where the arguments' strings live, so a test can tell a document
+ * that was moved in from one that was copied. */
+class ArgumentAddressHandler : public ToolHandler {
+public:
+    const char* seen = nullptr;
+
+    JsonDocument call(JsonDocument params) override {
+        seen = params["message"].as<const char*>();
+        JsonDocument result;
+        result["ok"] = true;
+        return result;
+    }
+};
+
+// Keeps a copy of every call's params, as a handler caching its last request would.
+class KeepingHandler : public ToolHandler {
+public:
+    JsonDocument kept;
+
+    JsonDocument call(JsonDocument params) override {
+        kept = params;
+        JsonDocument result;
+        result["ok"] = true;
+        return result;
+    }
+};
+
 class ParamInspectHandler : public ToolHandler {
 public:
     JsonDocument call(JsonDocument params) override {
@@ -119,6 +177,41 @@ public:
     }
 };
 
+// Returns a copy of whatever the test put in `result`.
+class FixedResultHandler : public ToolHandler {
+public:
+    JsonDocument result;
+
+    JsonDocument call(JsonDocument params) override {
+        (void)params;
+        return result;
+    }
+};
+
+/* Counts what a JsonDocument asks of the heap. Bytes are summed over every
+ * request, reallocations included, so the figure is traffic rather than peak. */
+class CountingAllocator : public ArduinoJson::Allocator {
+public:
+    size_t allocations = 0;
+    size_t deallocations = 0;
+    size_t bytes = 0;
+
+    void* allocate(size_t size) override {
+        allocations++;
+        bytes += size;
+        return malloc(size);
+    }
+    void deallocate(void* ptr) override {
+        deallocations++;
+        free(ptr);
+    }
+    void* reallocate(void* ptr, size_t newSize) override {
+        allocations++;
+        bytes += newSize;
+        return realloc(ptr, newSize);
+    }
+};
+
 static TestMCPServer* server;
 
 void setUp(void) {
@@ -136,16 +229,18 @@ void test_parse_valid_request(void) {
     MCPRequest req = server->parseRequest(
         R"({"jsonrpc":"2.0","id":1,"method":"initialize","params":{"protocolVersion":"2025-11-25","capabilities":{},"clientInfo":{"name":"test-client","version":"1.0.0"}}})");
 
-    TEST_ASSERT_EQUAL_STRING("initialize", req.method.c_str());
+    TEST_ASSERT_TRUE(MCPMethod::INITIALIZE == req.method);
     TEST_ASSERT_EQUAL(1, req.id().as<int>());
     TEST_ASSERT_TRUE(req.hasParams());
+    TEST_ASSERT_EQUAL_STRING("test-client", req.params()["clientInfo"]["name"].as<const char*>());
+    TEST_ASSERT_TRUE(req.arguments().isNull());
 }
 
 void test_parse_string_id(void) {
     MCPRequest req = server->parseRequest(
         R"({"jsonrpc":"2.0","id":"abc-123","method":"tools/list"})");
 
-    TEST_ASSERT_EQUAL_STRING("tools/list", req.method.c_str());
+    TEST_ASSERT_TRUE(MCPMethod::TOOLS_LIST == req.method);
     TEST_ASSERT_EQUAL_STRING("abc-123", req.id().as<const char*>());
 }
 
@@ -159,19 +254,19 @@ void test_parse_fractional_numeric_id(void) {
 
 void test_parse_invalid_json(void) {
     MCPRequest req = server->parseRequest("{invalid}");
-    TEST_ASSERT_EQUAL_STRING("", req.method.c_str());
+    TEST_ASSERT_TRUE(MCPMethod::NONE == req.method);
 }
 
 void test_parse_empty_string(void) {
     MCPRequest req = server->parseRequest("");
-    TEST_ASSERT_EQUAL_STRING("", req.method.c_str());
+    TEST_ASSERT_TRUE(MCPMethod::NONE == req.method);
 }
 
 void test_parse_no_params(void) {
     MCPRequest req = server->parseRequest(
         R"({"jsonrpc":"2.0","id":1,"method":"tools/list"})");
 
-    TEST_ASSERT_EQUAL_STRING("tools/list", req.method.c_str());
+    TEST_ASSERT_TRUE(MCPMethod::TOOLS_LIST == req.method);
     TEST_ASSERT_FALSE(req.hasParams());
 }
 
@@ -179,10 +274,71 @@ void test_parse_with_arguments(void) {
     MCPRequest req = server->parseRequest(
         R"({"jsonrpc":"2.0","id":5,"method":"tools/call","params":{"name":"echo","arguments":{"message":"hello"}}})");
 
-    TEST_ASSERT_EQUAL_STRING("tools/call", req.method.c_str());
+    TEST_ASSERT_TRUE(MCPMethod::TOOLS_CALL == req.method);
     TEST_ASSERT_TRUE(req.hasParams());
-    TEST_ASSERT_EQUAL_STRING("echo", req.params()["name"].as<const char*>());
-    TEST_ASSERT_EQUAL_STRING("hello", req.params()["arguments"]["message"].as<const char*>());
+    TEST_ASSERT_TRUE(req.hasToolName);
+    TEST_ASSERT_EQUAL_STRING("echo", req.name.c_str());
+    TEST_ASSERT_EQUAL_STRING("hello", req.arguments()["message"].as<const char*>());
+    // params itself is never built for tools/call, so it does not pose as the arguments.
+    TEST_ASSERT_TRUE(req.params().isNull());
+}
+
+void test_parse_tools_call_builds_only_arguments(void) {
+    MCPRequest req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":5,"method":"tools/call","params":{"_meta":{"progressToken":"t"},"name":"echo","arguments":{"message":"hi"}}})");
+
+    // The tree holds params.arguments and nothing else from params.
+    TEST_ASSERT_EQUAL_STRING("hi", req.doc["message"].as<const char*>());
+    TEST_ASSERT_TRUE(req.doc["_meta"].isNull());
+    TEST_ASSERT_TRUE(req.doc["name"].isNull());
+}
+
+void test_scan_builds_no_tree_until_materialized(void) {
+    const char* json = R"({"jsonrpc":"2.0","id":3,"method":"tools/call","params":{"name":"echo","arguments":{"message":"hi"}}})";
+    MCPRequest req = server->scanRequest(json, strlen(json));
+
+    TEST_ASSERT_FALSE(req.parseError);
+    TEST_ASSERT_EQUAL(3, req.id().as<int>());
+    TEST_ASSERT_EQUAL_STRING("echo", req.name.c_str());
+    TEST_ASSERT_FALSE(req.hasParams());
+
+    server->materializeRequest(req);
+    TEST_ASSERT_TRUE(req.hasParams());
+    TEST_ASSERT_EQUAL_STRING("hi", req.arguments()["message"].as<const char*>());
+}
+
+void test_unknown_method_params_are_never_built(void) {
+    MCPRequest req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":1,"method":"vendor/op","params":{"big":[1,2,3,4,5]}})");
+    TEST_ASSERT_FALSE(req.hasParams());
+
+    MCPResponse res = server->handle(req);
+    TEST_ASSERT_EQUAL(-32601, res.error()["code"].as<int>());
+}
+
+void test_parse_member_order_and_escapes_do_not_matter(void) {
+    MCPRequest req = server->parseRequest(
+        R"({"params":{"arguments":{"message":"a\"b"},"name":"e\u0063ho"},"method":"tools\/call","id":"x","jsonrpc":"2.0"})");
+
+    TEST_ASSERT_FALSE(req.parseError);
+    TEST_ASSERT_FALSE(req.invalidRequest);
+    TEST_ASSERT_TRUE(MCPMethod::TOOLS_CALL == req.method);
+    TEST_ASSERT_EQUAL_STRING("x", req.id().as<const char*>());
+    TEST_ASSERT_EQUAL_STRING("echo", req.name.c_str());
+    TEST_ASSERT_EQUAL_STRING("a\"b", req.arguments()["message"].as<const char*>());
+}
+
+void test_parse_rejects_what_deserialize_json_rejects(void) {
+    const char* malformed[] = {
+        R"({"jsonrpc":"2.0","id":1,"method":"ping",})",
+        R"({"jsonrpc":"2.0","id":01,"method":"ping"})",
+        R"({"jsonrpc":"2.0","id":1,"method":"ping","params":{"a":[[[[[[[[[[1]]]]]]]]]]}})",
+    };
+
+    for (const char* json : malformed) {
+        MCPRequest req = server->parseRequest(json);
+        TEST_ASSERT_TRUE(req.parseError);
+    }
 }
 
 void test_invalid_jsonrpc_envelope_is_rejected(void) {
@@ -372,14 +528,72 @@ void test_tools_list_body_is_cached_between_calls(void) {
     tool.handler = std::make_shared<EchoHandler>();
     server->RegisterTool(tool);
 
-    TEST_ASSERT_NOT_NULL(strstr(server->toolsListJson().c_str(), "original"));
+    TEST_ASSERT_NOT_NULL(strstr(server->toolsListJson()->c_str(), "original"));
 
     /* Mutate the stored tool behind RegisterTool's back, so nothing marks the
      * cache dirty. A rebuild-per-request implementation would pick the new
      * description up; the cache must not. */
-    server->tools.find("cached")->second.description = "mutated";
-    TEST_ASSERT_NOT_NULL(strstr(server->toolsListJson().c_str(), "original"));
-    TEST_ASSERT_NULL(strstr(server->toolsListJson().c_str(), "mutated"));
+    server->tools.find("cached")->second.description = ToolString::literal("mutated");
+    TEST_ASSERT_NOT_NULL(strstr(server->toolsListJson()->c_str(), "original"));
+    TEST_ASSERT_NULL(strstr(server->toolsListJson()->c_str(), "mutated"));
+}
+
+void test_registered_schemas_are_kept_as_text(void) {
+    Tool tool;
+    tool.name = "text";
+    tool.description = "Quoted \"description\"";
+    tool.inputSchema = Schema::object().property("message", Schema::string()).required({"message"}).build();
+    tool.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(tool);
+
+    // The stored text is what tools/list splices in, byte for byte.
+    const RegisteredTool& registered = server->tools.find("text")->second;
+    std::string expected;
+    serializeJson(tool.inputSchema, expected);
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(),
+                             std::string(registered.inputSchema.data(), registered.inputSchema.size()).c_str());
+    TEST_ASSERT_TRUE(registered.outputSchema.empty());
+    TEST_ASSERT_NOT_NULL(strstr(server->toolsListJson()->c_str(), ("\"inputSchema\":" + expected).c_str()));
+    TEST_ASSERT_NOT_NULL(strstr(server->toolsListJson()->c_str(), R"("description":"Quoted \"description\"")"));
+
+    // A tree is parsed back only when asked for.
+    JsonDocument schema = server->inputSchemaOf("text");
+    TEST_ASSERT_EQUAL_STRING("string", schema["properties"]["message"]["type"].as<const char*>());
+    TEST_ASSERT_TRUE(server->inputSchemaOf("missing").isNull());
+}
+
+static void registerVerboseTool(const char* name) {
+    Tool tool;
+    tool.name = name;
+    tool.description = std::string(MCP_PSRAM_THRESHOLD + 256, 'd').c_str();
+    tool.inputSchema = Schema::object().build();
+    tool.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(tool);
+}
+
+void test_large_tools_list_is_placed_in_psram(void) {
+    /* A tools/list body over the threshold: the tool's cached entry and the
+     * list built from it go to PSRAM. On a board without PSRAM both fall back
+     * to internal RAM and the reply is unchanged. */
+    registerVerboseTool("verbose");
+    mock_heap_caps::reset();
+    MCPRequest req = server->parseRequest(R"({"jsonrpc":"2.0","id":1,"method":"tools/list"})");
+    MCPResponse res = server->handle(req);
+    const std::string withPsram = server->serializeResponse(res);
+
+    TEST_ASSERT_GREATER_OR_EQUAL(2, mock_heap_caps::spiram().allocations.load());
+    TEST_ASSERT_GREATER_THAN(MCP_PSRAM_THRESHOLD, mock_heap_caps::spiram().smallest.load());
+
+    mock_heap_caps::setSpiramAvailable(false);
+    registerVerboseTool("verbose");  // same tool set, but the cache is rebuilt
+    mock_heap_caps::reset();
+    MCPResponse internalRes = server->handle(req);
+    const std::string withoutPsram = server->serializeResponse(internalRes);
+    mock_heap_caps::setSpiramAvailable(true);
+
+    TEST_ASSERT_EQUAL(0, mock_heap_caps::spiram().allocations.load());
+    TEST_ASSERT_GREATER_THAN(MCP_PSRAM_THRESHOLD, mock_heap_caps::internal().largest.load());
+    TEST_ASSERT_EQUAL_STRING(withPsram.c_str(), withoutPsram.c_str());
 }
 
 void test_registering_a_tool_invalidates_the_tools_list_cache(void) {
@@ -418,6 +632,7 @@ void test_register_tool_move_overload_registers_and_invalidates(void) {
     server->RegisterTool(std::move(tool));
 
     TEST_ASSERT_EQUAL(1, server->tools.size());
+    TEST_ASSERT_NULL(tool.handler.get());  // moved into the registry, not shared
 
     MCPRequest req = server->parseRequest(
         R"({"jsonrpc":"2.0","id":1,"method":"tools/list"})");
@@ -433,6 +648,574 @@ void test_register_tool_move_overload_registers_and_invalidates(void) {
         listed["inputSchema"]["properties"]["field"]["type"].as<const char*>());
 }
 
+/* ======== argument filters ======== */
+
+/* Parses `json` with the arguments tree on `allocator`. The allocator must
+ * outlive `req`. */
+static void materializeCounting(const std::string& json, CountingAllocator& allocator, MCPRequest& req) {
+    req = server->scanRequest(json.data(), json.size());
+    req.doc = JsonDocument(&allocator);
+    server->materializeRequest(req);
+    TEST_ASSERT_FALSE(req.parseError);
+}
+
+static std::string toolCallWithBlob(const char* tool, const std::string& blob) {
+    return std::string(R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":")") + tool +
+           R"(","arguments":{"message":"hi","blob":")" + blob + R"("}}})";
+}
+
+void test_argument_filter_drops_undeclared_fields(void) {
+    Tool declared;
+    declared.name = "declared";
+    declared.description = "Declares message only";
+    declared.inputSchema =
+        Schema::object().property("message", Schema::string()).additionalProperties(false).build();
+    declared.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(declared);
+
+    Tool open;
+    open.name = "open";
+    open.description = "Declares nothing";
+    open.inputSchema = Schema::object().build();
+    open.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(open);
+
+    const std::string blob(2048, 'x');
+    CountingAllocator filteredHeap, unfilteredHeap;
+    MCPRequest filtered, unfiltered;
+    materializeCounting(toolCallWithBlob("declared", blob), filteredHeap, filtered);
+    materializeCounting(toolCallWithBlob("open", blob), unfilteredHeap, unfiltered);
+
+    TEST_ASSERT_EQUAL_STRING("hi", filtered.arguments()["message"].as<const char*>());
+    TEST_ASSERT_TRUE(filtered.arguments()["blob"].isNull());
+    TEST_ASSERT_EQUAL(blob.size(), strlen(unfiltered.arguments()["blob"].as<const char*>()));
+
+    char report[128];
+    snprintf(report, sizeof(report), "arguments heap: filtered %u B in %u allocs, unfiltered %u B in %u allocs",
+             (unsigned)filteredHeap.bytes, (unsigned)filteredHeap.allocations, (unsigned)unfilteredHeap.bytes,
+             (unsigned)unfilteredHeap.allocations);
+    TEST_MESSAGE(report);
+    TEST_ASSERT_LESS_OR_EQUAL(unfilteredHeap.allocations, filteredHeap.allocations);
+    TEST_ASSERT_LESS_OR_EQUAL(unfilteredHeap.bytes - blob.size(), filteredHeap.bytes);
+}
+
+static constexpr auto kStaticInput = schemaLiteral([] {
+    return StaticSchema::object()
+        .additionalProperties(false)
+        .property("message", StaticSchema::string())
+        .required("message");
+});
+static constexpr auto kStaticOutput = schemaLiteral([] {
+    return StaticSchema::object().property("echo", StaticSchema::string());
+});
+
+void test_tools_list_reuses_cached_tool_entries(void) {
+    Tool first;
+    first.name = "first";
+    first.description = "Serialized once";
+    first.inputSchema = Schema::object().property("message", Schema::string()).build();
+    first.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(first);
+    server->toolsListJson();
+
+    // The tool's own schema text now lives in its entry, not beside it.
+    const RegisteredTool& cached = server->tools.find("first")->second;
+    const char* entry = cached.listEntry.data();
+    TEST_ASSERT_TRUE(cached.inputSchema.data() > entry);
+    TEST_ASSERT_TRUE(cached.inputSchema.data() + cached.inputSchema.size() < entry + cached.listEntry.size());
+    std::string expected;
+    serializeJson(first.inputSchema, expected);
+    TEST_ASSERT_EQUAL_STRING(("{\"name\":\"first\",\"description\":\"Serialized once\",\"inputSchema\":" + expected +
+                              "}").c_str(),
+                             cached.listEntry.c_str());
+
+    // Registering another tool serializes that one alone.
+    Tool second;
+    second.name = "second";
+    second.description = "Added later";
+    second.inputSchema = Schema::object().build();
+    second.outputSchema = Schema::object().property("echo", Schema::string()).build();
+    second.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(second);
+    std::shared_ptr<const JsonText> list = server->toolsListJson();
+    TEST_ASSERT_EQUAL_PTR(entry, server->tools.find("first")->second.listEntry.data());
+    TEST_ASSERT_NOT_NULL(strstr(list->c_str(), cached.listEntry.c_str()));
+    TEST_ASSERT_NOT_NULL(strstr(list->c_str(), server->tools.find("second")->second.listEntry.c_str()));
+
+    JsonDocument body;
+    TEST_ASSERT_FALSE(deserializeJson(body, list->c_str()));
+    TEST_ASSERT_EQUAL(2, body["tools"].size());
+    TEST_ASSERT_EQUAL_STRING("string",
+        body["tools"][1]["outputSchema"]["properties"]["echo"]["type"].as<const char*>());
+    JsonDocument schema = server->inputSchemaOf("first");
+    TEST_ASSERT_EQUAL_STRING("string", schema["properties"]["message"]["type"].as<const char*>());
+}
+
+void test_tools_list_replies_share_the_cached_buffer(void) {
+    Tool tool;
+    tool.name = "shared";
+    tool.description = "Listed by reference";
+    tool.inputSchema = Schema::object().build();
+    tool.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(tool);
+
+    MCPRequest req = server->parseRequest(R"({"jsonrpc":"2.0","id":1,"method":"tools/list"})");
+    MCPResponse first = server->handle(req);
+    MCPResponse second = server->handle(req);
+    TEST_ASSERT_TRUE(first.kind() == MCPResponse::Kind::RAW);
+    TEST_ASSERT_EQUAL_PTR(first.raw().get(), second.raw().get());
+    TEST_ASSERT_EQUAL_PTR(server->toolsListJson().get(), first.raw().get());
+
+    // A rebuild leaves the list a reply already holds as it was.
+    tool.name = "added";
+    server->RegisterTool(tool);
+    MCPResponse third = server->handle(req);
+    TEST_ASSERT_TRUE(third.raw().get() != first.raw().get());
+    TEST_ASSERT_NULL(strstr(first.raw()->c_str(), "\"added\""));
+    TEST_ASSERT_NOT_NULL(strstr(third.raw()->c_str(), "\"added\""));
+    JsonDocument body;
+    parseResponseBody(server, first, body);
+    TEST_ASSERT_EQUAL(1, body["result"]["tools"].size());
+}
+
+void test_static_schemas_are_spliced_without_a_copy(void) {
+    Tool tool;
+    tool.name = "static";
+    tool.description = "Flash schemas";
+    tool.staticInputSchema = kStaticInput.c_str();
+    tool.staticOutputSchema = kStaticOutput.c_str();
+    tool.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(tool);
+
+    const RegisteredTool& registered = server->tools.find("static")->second;
+    TEST_ASSERT_EQUAL_PTR(kStaticInput.c_str(), registered.inputSchema.data());
+    TEST_ASSERT_EQUAL_PTR(kStaticOutput.c_str(), registered.outputSchema.data());
+    TEST_ASSERT_NOT_NULL(strstr(server->toolsListJson()->c_str(),
+                                (std::string("\"inputSchema\":") + kStaticInput.c_str() + ",\"outputSchema\":" +
+                                 kStaticOutput.c_str() + "}")
+                                    .c_str()));
+
+    // The argument filter is still compiled from it.
+    CountingAllocator heap;
+    MCPRequest req;
+    materializeCounting(toolCallWithBlob("static", std::string(64, 'x')), heap, req);
+    TEST_ASSERT_EQUAL_STRING("hi", req.arguments()["message"].as<const char*>());
+    TEST_ASSERT_TRUE(req.arguments()["blob"].isNull());
+}
+
+void test_literal_tool_metadata_is_not_copied(void) {
+    static const char kName[] = "literal";
+    static const char kDescription[] = "A description long enough that a String would have to allocate it";
+    Tool tool;
+    tool.staticName = kName;
+    tool.staticDescription = kDescription;
+    tool.staticInputSchema = kStaticInput.c_str();
+    tool.handler = std::make_shared<EchoHandler>();
+    mock_heap_caps::reset();
+    server->RegisterTool(tool);
+    TEST_ASSERT_EQUAL(0, mock_heap_caps::internal().allocations.load());
+    TEST_ASSERT_EQUAL(0, mock_heap_caps::spiram().allocations.load());
+
+    const RegisteredTool& registered = server->tools.find("literal")->second;
+    TEST_ASSERT_EQUAL_PTR(kName, registered.name.c_str());
+    TEST_ASSERT_EQUAL_PTR(kDescription, registered.description.c_str());
+    TEST_ASSERT_EQUAL_PTR(kName, server->tools.begin()->first.data());
+    TEST_ASSERT_NOT_NULL(strstr(server->toolsListJson()->c_str(), kDescription));
+
+    // The same metadata as Strings is copied, once each.
+    Tool copied;
+    copied.name = "literal";
+    copied.description = kDescription;
+    copied.staticInputSchema = kStaticInput.c_str();
+    copied.handler = std::make_shared<EchoHandler>();
+    mock_heap_caps::reset();
+    server->RegisterTool(copied);
+    TEST_ASSERT_EQUAL(2, mock_heap_caps::internal().allocations.load());
+    TEST_ASSERT_EQUAL(1, server->tools.size());
+    TEST_ASSERT_NOT_EQUAL(kName, server->tools.begin()->first.data());
+    TEST_ASSERT_EQUAL_STRING("literal", server->tools.begin()->first.data());
+
+    MCPRequest req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"literal","arguments":{"message":"hi"}}})");
+    MCPResponse res = server->handle(req);
+    TEST_ASSERT_FALSE(res.hasError());
+}
+
+static void staticEcho(JsonVariantConst arguments, JsonObject result, bool& isError) {
+    isError = strcmp(arguments["message"].as<const char*>(), "fail") == 0;
+    if (isError) {
+        result["error"] = "asked to fail";
+        return;
+    }
+    result["echo"] = arguments["message"];
+}
+
+static constexpr StaticTool kStaticTools[] = {
+    {"static_echo", "Echo from \"flash\"", kStaticInput.c_str(), kStaticOutput.c_str(), staticEcho},
+    {"static_bare", "No output schema", kStaticInput.c_str(), nullptr, staticEcho},
+};
+static constexpr auto kStaticToolTable = toolTable([]() -> const auto& { return kStaticTools; });
+
+void test_static_tool_table_is_listed_in_place(void) {
+    server->RegisterTools(kStaticToolTable);
+
+    // The compile-time list is served as is.
+    TEST_ASSERT_EQUAL_PTR(kStaticToolTable.toolsList.c_str(), server->toolsListJson()->data());
+    JsonDocument list;
+    TEST_ASSERT_FALSE(deserializeJson(list, kStaticToolTable.toolsList.c_str()));
+    TEST_ASSERT_EQUAL(2, list["tools"].size());
+    TEST_ASSERT_EQUAL_STRING("Echo from \"flash\"", list["tools"][0]["description"].as<const char*>());
+    TEST_ASSERT_EQUAL_STRING("message", list["tools"][0]["inputSchema"]["required"][0].as<const char*>());
+    TEST_ASSERT_EQUAL_STRING("string", list["tools"][0]["outputSchema"]["properties"]["echo"]["type"].as<const char*>());
+    TEST_ASSERT_TRUE(list["tools"][1]["outputSchema"].isNull());
+
+    MCPRequest req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"static_echo","arguments":{"message":"hi","blob":"x"}}})");
+    TEST_ASSERT_TRUE(req.arguments()["blob"].isNull());  // its filter was compiled
+    MCPResponse res = server->handle(req);
+    TEST_ASSERT_EQUAL_STRING("Invalid arguments: 'blob' is not allowed", res.error()["message"].as<const char*>());
+    req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"static_echo","arguments":{"message":"hi"}}})");
+    res = server->handle(req);
+    TEST_ASSERT_FALSE(res.hasError());
+    TEST_ASSERT_EQUAL_STRING("hi", res.result()["structuredContent"]["echo"].as<const char*>());
+    TEST_ASSERT_FALSE(res.result()["isError"].as<bool>());
+
+    // A failure built in place reaches the client as text.
+    req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":2,"method":"tools/call",)"
+        R"("params":{"name":"static_bare","arguments":{"message":"fail"}}})");
+    res = server->handle(req);
+    JsonDocument body;
+    JsonVariantConst failed = toolResult(server, res, body);
+    TEST_ASSERT_TRUE(failed["isError"].as<bool>());
+    TEST_ASSERT_EQUAL_STRING(R"({"error":"asked to fail"})", failed["content"][0]["text"].as<const char*>());
+}
+
+void test_static_tool_table_is_listed_after_registered_tools(void) {
+    server->RegisterTools(kStaticToolTable);
+    Tool tool;
+    tool.name = "dynamic";
+    tool.description = "Registered at run time";
+    tool.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(tool);
+
+    JsonDocument list;
+    TEST_ASSERT_FALSE(deserializeJson(list, server->toolsListJson()->c_str()));
+    TEST_ASSERT_EQUAL(3, list["tools"].size());
+    TEST_ASSERT_EQUAL_STRING("dynamic", list["tools"][0]["name"].as<const char*>());
+    TEST_ASSERT_EQUAL_STRING("static_echo", list["tools"][1]["name"].as<const char*>());
+    TEST_ASSERT_EQUAL_STRING("static_bare", list["tools"][2]["name"].as<const char*>());
+
+    MCPRequest req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":2,"method":"tools/call","params":{"name":"static_bare","arguments":{"message":"yo"}}})");
+    MCPResponse res = server->handle(req);
+    TEST_ASSERT_EQUAL_STRING("yo", res.result()["structuredContent"]["echo"].as<const char*>());
+}
+
+// Sends tools/list, with `cursor` unless it is empty, and parses the reply into `body`.
+static void listTools(TestMCPServer* server, const std::string& cursor, JsonDocument& body) {
+    std::string json = R"({"jsonrpc":"2.0","id":1,"method":"tools/list")";
+    json += cursor.empty() ? "}" : R"(,"params":{"cursor":")" + cursor + R"("}})";
+    MCPRequest req = server->parseRequest(json);
+    MCPResponse res = server->handle(req);
+    parseResponseBody(server, res, body);
+}
+
+void test_tools_list_is_paged_with_cursors(void) {
+    // A small catalog is one page with no cursor, and accepts none.
+    JsonDocument body;
+    registerVerboseTool("small");
+    listTools(server, "", body);
+    TEST_ASSERT_TRUE(body["result"]["nextCursor"].isNull());
+    listTools(server, "1", body);
+    TEST_ASSERT_EQUAL(static_cast<int>(ErrorCode::INVALID_PARAMS), body["error"]["code"].as<int>());
+#if MCP_TOOLS_LIST_PAGE_SIZE > 0
+    /* One short of a page of registered tools, then the table: the page
+     * boundary falls between the table's entries. */
+    for (int i = 0; i < MCP_TOOLS_LIST_PAGE_SIZE - 2; ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), "tool%03d", i);
+        Tool tool;
+        tool.name = name;
+        tool.description = "Paged";
+        tool.inputSchema = Schema::object().build();
+        tool.handler = std::make_shared<EchoHandler>();
+        server->RegisterTool(tool);
+    }
+    server->RegisterTools(kStaticToolTable);
+
+    std::vector<std::string> names;
+    std::string cursor;
+    int pages = 0;
+    do {
+        listTools(server, cursor, body);
+        JsonArrayConst tools = body["result"]["tools"].as<JsonArrayConst>();
+        TEST_ASSERT_FALSE(tools.isNull());
+        TEST_ASSERT_LESS_OR_EQUAL(MCP_TOOLS_LIST_PAGE_SIZE, tools.size());
+        for (JsonObjectConst tool : tools) {
+            names.push_back(tool["name"].as<const char*>());
+            TEST_ASSERT_TRUE(tool["inputSchema"].is<JsonObjectConst>());
+        }
+        cursor = body["result"]["nextCursor"].isNull() ? "" : body["result"]["nextCursor"].as<const char*>();
+        ++pages;
+    } while (!cursor.empty() && pages < 10);
+
+    TEST_ASSERT_EQUAL(2, pages);
+    TEST_ASSERT_EQUAL(MCP_TOOLS_LIST_PAGE_SIZE + 1, static_cast<int>(names.size()));
+    TEST_ASSERT_EQUAL_STRING("small", names.front().c_str());
+    TEST_ASSERT_EQUAL_STRING("static_echo", names[MCP_TOOLS_LIST_PAGE_SIZE - 1].c_str());
+    TEST_ASSERT_EQUAL_STRING("static_bare", names.back().c_str());
+    listTools(server, std::to_string(MCP_TOOLS_LIST_PAGE_SIZE), body);
+    TEST_ASSERT_EQUAL_STRING("No output schema", body["result"]["tools"][0]["description"].as<const char*>());
+    TEST_ASSERT_TRUE(body["result"]["tools"][0]["outputSchema"].isNull());
+
+    // Cursors this server never hands out, including in-range positions that are not a page start.
+    for (const char* bad : {"0", "99", "-1", "1x", "abc"}) {
+        listTools(server, bad, body);
+        TEST_ASSERT_EQUAL(static_cast<int>(ErrorCode::INVALID_PARAMS), body["error"]["code"].as<int>());
+    }
+    for (const std::string& bad : {std::to_string(MCP_TOOLS_LIST_PAGE_SIZE - 1),
+                                   "0" + std::to_string(MCP_TOOLS_LIST_PAGE_SIZE)}) {
+        listTools(server, bad, body);
+        TEST_ASSERT_EQUAL(static_cast<int>(ErrorCode::INVALID_PARAMS), body["error"]["code"].as<int>());
+    }
+    MCPRequest req = server->parseRequest(R"({"jsonrpc":"2.0","id":1,"method":"tools/list","params":{"cursor":5}})");
+    parseResponseBody(server, server->handle(req), body);
+    TEST_ASSERT_EQUAL(static_cast<int>(ErrorCode::INVALID_PARAMS), body["error"]["code"].as<int>());
+#endif
+}
+
+void test_argument_filter_follows_nested_objects_and_arrays(void) {
+    Tool tool;
+    tool.name = "nested";
+    tool.description = "Nested";
+    tool.inputSchema = Schema::object()
+        .property("opts", Schema::object().property("a", Schema::integer()).additionalProperties(false))
+        .property("points", Schema::array().items(
+            Schema::object().property("x", Schema::number()).additionalProperties(false)))
+        .property("raw", Schema::object())
+        .property("open", Schema::object().property("a", Schema::integer()))
+        .additionalProperties(false)
+        .build();
+    tool.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(tool);
+
+    MCPRequest req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"nested","arguments":)"
+        R"({"opts":{"a":1,"b":2},"points":[{"x":1,"y":2},{"x":3,"z":4}],"raw":{"any":true},)"
+        R"("open":{"a":1,"b":2},"extra":0}}})");
+
+    JsonVariantConst args = req.arguments();
+    TEST_ASSERT_EQUAL(1, args["opts"]["a"].as<int>());
+    TEST_ASSERT_TRUE(args["opts"]["b"].isNull());
+    TEST_ASSERT_EQUAL(2, args["points"].size());
+    TEST_ASSERT_EQUAL(3, args["points"][1]["x"].as<int>());
+    TEST_ASSERT_TRUE(args["points"][0]["y"].isNull());
+    TEST_ASSERT_TRUE(args["raw"]["any"].as<bool>());  // declares no members, so kept whole
+    TEST_ASSERT_EQUAL(2, args["open"]["b"].as<int>());  // not closed, so kept whole
+    TEST_ASSERT_TRUE(args["extra"].isNull());
+}
+
+void test_argument_filter_respects_additional_properties(void) {
+    Tool tool;
+    tool.name = "extensible";
+    tool.description = "Extensible";
+    tool.inputSchema = Schema::object().property("message", Schema::string()).additionalProperties(true).build();
+    tool.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(tool);
+
+    MCPRequest req = server->parseRequest(toolCallWithBlob("extensible", "kept"));
+    TEST_ASSERT_EQUAL_STRING("kept", req.arguments()["blob"].as<const char*>());
+
+    // Without the keyword, undeclared members are allowed, and kept, as well.
+    tool.inputSchema = Schema::object().property("message", Schema::string()).build();
+    server->RegisterTool(tool);
+    req = server->parseRequest(toolCallWithBlob("extensible", "kept"));
+    TEST_ASSERT_EQUAL_STRING("kept", req.arguments()["blob"].as<const char*>());
+    TEST_ASSERT_FALSE(server->handle(req).hasError());
+
+    // Re-registering with a closed schema replaces the filter.
+    tool.inputSchema = Schema::object().property("message", Schema::string()).additionalProperties(false).build();
+    server->RegisterTool(tool);
+    req = server->parseRequest(toolCallWithBlob("extensible", "dropped"));
+    TEST_ASSERT_TRUE(req.arguments()["blob"].isNull());
+}
+
+/* ======== argument validation ======== */
+
+static void registerCheckedTool() {
+    Tool tool;
+    tool.name = "checked";
+    tool.description = "Checked";
+    tool.inputSchema = Schema::object()
+        .property("text", Schema::string().minLength(1).maxLength(8))
+        .property("count", Schema::integer().minimum(1).exclusiveMaximum(10))
+        .property("mode", Schema::string().enumValues({"fast", "slow"}))
+        .property("tags", Schema::array().items(Schema::string()).maxItems(2))
+        .property("opts", Schema::object().property("flag", Schema::boolean()).additionalProperties(false))
+        .required({"text"})
+        .build();
+    tool.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(tool);
+}
+
+// The reason checkArguments gives for `arguments`, or "" when they pass.
+static std::string argumentProblem(const char* tool, const std::string& arguments) {
+    const std::string json = R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":")" +
+                             std::string(tool) + "\"" + (arguments.empty() ? "" : ",\"arguments\":" + arguments) + "}}";
+    MCPRequest req = server->scanRequest(json.data(), json.size());
+    std::string problem;
+    const bool passed = server->checkArguments(req, problem);
+    TEST_ASSERT_EQUAL(passed, problem.empty());
+    return problem;
+}
+
+void test_arguments_are_checked_against_the_input_schema(void) {
+    registerCheckedTool();
+
+    const char* valid =
+        R"({"text":"h\u00e9llo","count":3.0,"mode":"sl\u006fw","tags":["a"],"opts":{"flag":true},"extra":[1]})";
+    TEST_ASSERT_EQUAL_STRING("", argumentProblem("checked", valid).c_str());
+    TEST_ASSERT_EQUAL_STRING("'text' is required", argumentProblem("checked", "{}").c_str());
+    TEST_ASSERT_EQUAL_STRING("'text' is required", argumentProblem("checked", "").c_str());
+    TEST_ASSERT_EQUAL_STRING("'text' must be of type string", argumentProblem("checked", R"({"text":5})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'text' is too short", argumentProblem("checked", R"({"text":""})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'text' is too long", argumentProblem("checked", R"({"text":"123456789"})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'count' must be of type integer",
+                             argumentProblem("checked", R"({"text":"a","count":2.5})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'count' is out of range",
+                             argumentProblem("checked", R"({"text":"a","count":10})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'count' is out of range",
+                             argumentProblem("checked", R"({"text":"a","count":0})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'mode' is not one of the allowed values",
+                             argumentProblem("checked", R"({"text":"a","mode":"medium"})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'tags' items must be of type string",
+                             argumentProblem("checked", R"({"text":"a","tags":["a",1]})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'tags' has too many items",
+                             argumentProblem("checked", R"({"text":"a","tags":["a","b","c"]})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'x' is not allowed",
+                             argumentProblem("checked", R"({"text":"a","opts":{"flag":true,"x":1}})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'flag' must be of type boolean",
+                             argumentProblem("checked", R"({"text":"a","opts":{"flag":null}})").c_str());
+
+    // A closed object that declares no properties, as a tool taking no arguments has, admits none.
+    Tool none;
+    none.name = "none";
+    none.description = "No arguments";
+    none.inputSchema = Schema::object()
+        .property("opts", Schema::object().additionalProperties(false))
+        .additionalProperties(false)
+        .build();
+    none.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(none);
+    TEST_ASSERT_EQUAL_STRING("", argumentProblem("none", "{}").c_str());
+    TEST_ASSERT_EQUAL_STRING("", argumentProblem("none", R"({"opts":{}})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'x' is not allowed", argumentProblem("none", R"({"x":1})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'y' is not allowed", argumentProblem("none", R"({"opts":{"y":1}})").c_str());
+
+    // Unknown tools and malformed arguments are left to handleFunctionCalls.
+    TEST_ASSERT_EQUAL_STRING("", argumentProblem("missing", "{}").c_str());
+    TEST_ASSERT_EQUAL_STRING("", argumentProblem("checked", "[]").c_str());
+}
+
+void test_arguments_are_checked_when_handled_directly(void) {
+    registerCheckedTool();
+
+    // parseRequest() callers never pass through handleJsonBody's check.
+    MCPRequest req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"checked","arguments":{"count":3}}})");
+    MCPResponse res = server->handle(req);
+    JsonDocument body;
+    parseResponseBody(server, res, body);
+    TEST_ASSERT_EQUAL(static_cast<int>(ErrorCode::INVALID_PARAMS), body["error"]["code"].as<int>());
+    TEST_ASSERT_EQUAL_STRING("Invalid arguments: 'text' is required", body["error"]["message"].as<const char*>());
+
+    req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":2,"method":"tools/call","params":{"name":"checked","arguments":{"text":"ok"}}})");
+    res = server->handle(req);
+    TEST_ASSERT_FALSE(toolResult(server, res, body)["isError"].as<bool>());
+}
+
+void test_inclusive_and_exclusive_bounds_are_both_enforced(void) {
+    Tool tool;
+    tool.name = "bounded";
+    tool.description = "Bounded";
+    tool.inputSchema = Schema::object()
+        .property("low", Schema::number().minimum(5).exclusiveMinimum(0))
+        .property("high", Schema::number().exclusiveMaximum(10).maximum(20))
+        .build();
+    tool.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(tool);
+
+    TEST_ASSERT_EQUAL_STRING("", argumentProblem("bounded", R"({"low":5,"high":9.5})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'low' is out of range", argumentProblem("bounded", R"({"low":3})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'low' is out of range", argumentProblem("bounded", R"({"low":0})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'high' is out of range", argumentProblem("bounded", R"({"high":10})").c_str());
+    TEST_ASSERT_EQUAL_STRING("'high' is out of range", argumentProblem("bounded", R"({"high":15})").c_str());
+}
+
+void test_schemas_that_constrain_nothing_get_no_validator(void) {
+    Tool tool;
+    tool.name = "open";
+    tool.description = "Open";
+    tool.inputSchema = Schema::object()
+        .property("either", Schema::object().oneOf({Schema::string(), Schema::integer()}))
+        .build();
+    tool.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(tool);
+    TEST_ASSERT_EQUAL_STRING("", argumentProblem("open", R"({"any":1,"either":[true]})").c_str());
+
+    // Re-registering with a constraint adds one; dropping it again removes it.
+    tool.inputSchema = Schema::object().property("any", Schema::string()).build();
+    server->RegisterTool(tool);
+    TEST_ASSERT_EQUAL_STRING("'any' must be of type string", argumentProblem("open", R"({"any":1})").c_str());
+    tool.inputSchema = Schema::object().build();
+    server->RegisterTool(tool);
+    TEST_ASSERT_EQUAL_STRING("", argumentProblem("open", R"({"any":1})").c_str());
+}
+
+void test_argument_validation_benchmark(void) {
+    /* Reports rather than asserts: the cost of checking a call's arguments,
+     * per KiB of them, against building their tree, which is what the
+     * worker would do first. */
+    registerCheckedTool();
+    std::string arguments = R"({"text":"ok","count":5,"tags":["a","b"],"extra":[)";
+    for (int i = 0; arguments.size() < 4 * 1024; ++i) {
+        arguments += (i ? "," : "") + std::string(R"({"n":)") + std::to_string(i) + R"(,"label":"row \"quoted\""})";
+    }
+    arguments += "]}";
+    const std::string json =
+        R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"checked","arguments":)" + arguments + "}}";
+
+    const int rounds = 200;
+    std::string problem;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        MCPRequest req = server->scanRequest(json.data(), json.size());
+        TEST_ASSERT_TRUE(server->checkArguments(req, problem));
+    }
+    auto checked = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        MCPRequest req = server->scanRequest(json.data(), json.size());
+        req.argumentsChecked = true;  // as handleJsonBody leaves it, so only the build is timed
+        server->materializeRequest(req);
+    }
+    auto built = std::chrono::steady_clock::now() - start;
+
+    const double kib = arguments.size() / 1024.0;
+    auto perKib = [&](std::chrono::steady_clock::duration total) {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(total).count();
+        return static_cast<long long>(ns / rounds / kib);
+    };
+    char message[128];
+    snprintf(message, sizeof(message), "%.1f KiB of arguments: %lld ns/KiB to check (%lld ns/KiB to build the tree)",
+             kib, perKib(checked), perKib(built));
+    TEST_MESSAGE(message);
+}
+
 /* ======== handle: tools/call ======== */
 
 void test_handle_tool_call_success(void) {
@@ -446,16 +1229,446 @@ void test_handle_tool_call_success(void) {
     MCPRequest req = server->parseRequest(
         R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"echo","arguments":{"message":"hello"}}})");
     MCPResponse res = server->handle(req);
+    JsonDocument body;
+    JsonVariantConst result = toolResult(server, res, body);
 
     TEST_ASSERT_EQUAL(200, res.code);
     TEST_ASSERT_TRUE(res.hasResult());
     TEST_ASSERT_FALSE(res.hasError());
 
     JsonDocument payload;
-    readToolPayload(res.result(), payload);
+    readToolPayload(result, payload);
     TEST_ASSERT_EQUAL_STRING("hello", payload["echo"].as<const char*>());
-    TEST_ASSERT_EQUAL_STRING("hello", res.result()["structuredContent"]["echo"].as<const char*>());
-    TEST_ASSERT_FALSE(res.result()["isError"].as<bool>());
+    TEST_ASSERT_EQUAL_STRING("hello", result["structuredContent"]["echo"].as<const char*>());
+    TEST_ASSERT_FALSE(result["isError"].as<bool>());
+}
+
+void test_handle_tool_call_moves_arguments_into_the_handler(void) {
+    auto handler = std::make_shared<ArgumentAddressHandler>();
+    Tool tool;
+    tool.name = "address";
+    tool.description = "Address";
+    tool.inputSchema = Schema::object().build();
+    tool.handler = handler;
+    server->RegisterTool(tool);
+
+    MCPRequest req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"address","arguments":{"message":"hello"}}})");
+    const char* parsed = req.arguments()["message"].as<const char*>();
+    MCPResponse res = server->handle(req);
+
+    TEST_ASSERT_FALSE(res.hasError());
+    TEST_ASSERT_EQUAL_PTR(parsed, handler->seen);
+}
+
+/* One tools/call from parse to reply body with every document that honours
+ * MCPArena::Scope on `allocator`. Documents the handler builds itself stay on
+ * the default heap either way. */
+static std::string runScopedToolCall(ArduinoJson::Allocator* allocator, const char* json) {
+    MCPArena::Scope scope(allocator);
+    MCPRequest req = server->parseRequest(json);
+    MCPResponse res = server->handle(req);
+    return server->serializeResponse(res);
+}
+
+void test_request_arena_cuts_mallocs_per_request(void) {
+    Tool tool;
+    tool.name = "echo";
+    tool.description = "Echo";
+    tool.inputSchema = Schema::object()
+                           .property("message", Schema::string())
+                           .property("tags", Schema::array())
+                           .property("count", Schema::integer())
+                           .build();
+    tool.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(tool);
+
+    const char* call =
+        R"({"jsonrpc":"2.0","id":"req-42","method":"tools/call","params":{"name":"echo","arguments":)"
+        R"({"message":"hello","tags":["alpha","beta","gamma","delta"],"count":3}}})";
+
+    CountingAllocator heap;
+    const std::string direct = runScopedToolCall(&heap, call);
+
+    CountingAllocator upstream;
+    std::string pooled;
+    {
+        MCPArena arena(&upstream);
+        pooled = runScopedToolCall(&arena, call);
+        TEST_ASSERT_EQUAL(upstream.allocations, arena.blockCount());
+    }
+
+    TEST_ASSERT_EQUAL_STRING(direct.c_str(), pooled.c_str());
+    TEST_ASSERT_EQUAL(upstream.allocations, upstream.deallocations);
+
+    char report[128];
+    snprintf(report, sizeof(report), "request documents: %u heap allocations direct, %u with the arena",
+             (unsigned)heap.allocations, (unsigned)upstream.allocations);
+    TEST_MESSAGE(report);
+    TEST_ASSERT_LESS_THAN(heap.allocations, upstream.allocations);
+}
+
+void test_by_value_handler_may_keep_params_past_the_arena(void) {
+    auto handler = std::make_shared<KeepingHandler>();
+    Tool tool;
+    tool.name = "keep";
+    tool.description = "Keep";
+    tool.inputSchema = Schema::object().property("message", Schema::string()).build();
+    tool.handler = handler;
+    server->RegisterTool(tool);
+
+    CountingAllocator upstream;
+    {
+        MCPArena arena(&upstream);
+        runScopedToolCall(&arena, R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"keep",)"
+                                  R"("arguments":{"message":"kept past the reply"}}})");
+    }
+    TEST_ASSERT_EQUAL(upstream.allocations, upstream.deallocations);
+
+    // The arena is gone; under native-san, a copy still backed by it fails here.
+    TEST_ASSERT_EQUAL_STRING("kept past the reply", handler->kept["message"].as<const char*>());
+    handler->kept["more"] = "grown after the call";
+    TEST_ASSERT_EQUAL_STRING("grown after the call", handler->kept["more"].as<const char*>());
+}
+
+void test_request_arena_grows_and_releases_blocks(void) {
+    CountingAllocator upstream;
+    {
+        MCPArena arena(&upstream);
+        void* a = arena.allocate(16);
+        TEST_ASSERT_NOT_NULL(a);
+        TEST_ASSERT_EQUAL(1, arena.blockCount());
+
+        // The newest allocation grows where it is.
+        TEST_ASSERT_EQUAL_PTR(a, arena.reallocate(a, 64));
+
+        // Anything larger than a block gets one of its own.
+        void* big = arena.allocate(MCP_REQUEST_ARENA_BLOCK_SIZE * 2);
+        TEST_ASSERT_NOT_NULL(big);
+        TEST_ASSERT_EQUAL(2, arena.blockCount());
+
+        // Small allocations keep filling the first block.
+        void* b = arena.allocate(32);
+        TEST_ASSERT_NOT_NULL(b);
+        TEST_ASSERT_EQUAL(2, arena.blockCount());
+        memset(b, 0x5a, 32);
+        void* moved = arena.reallocate(a, MCP_REQUEST_ARENA_BLOCK_SIZE / 2);
+        TEST_ASSERT_NOT_NULL(moved);
+        TEST_ASSERT_EQUAL(0x5a, static_cast<uint8_t*>(b)[31]);
+        arena.deallocate(moved);
+        arena.deallocate(big);
+        arena.deallocate(b);
+    }
+    TEST_ASSERT_EQUAL(upstream.allocations, upstream.deallocations);
+}
+
+void test_result_writer_builds_in_place(void) {
+    Tool tool;
+    tool.name = "writer";
+    tool.description = "Writer";
+    tool.inputSchema = Schema::object().build();
+    tool.handler = std::make_shared<EchoWriter>();
+    server->RegisterTool(tool);
+
+    MCPRequest req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"writer","arguments":{"message":"hi"}}})");
+    MCPResponse res = server->handle(req);
+    JsonDocument body;
+    JsonVariantConst result = toolResult(server, res, body);
+
+    TEST_ASSERT_FALSE(res.hasError());
+    TEST_ASSERT_FALSE(result["isError"].as<bool>());
+    TEST_ASSERT_EQUAL_STRING("hi", result["structuredContent"]["echo"].as<const char*>());
+    JsonDocument payload;
+    readToolPayload(result, payload);
+    TEST_ASSERT_EQUAL_STRING("hi", payload["echo"].as<const char*>());
+}
+
+void test_result_writer_failure_is_sent_as_text_only(void) {
+    Tool tool;
+    tool.name = "writer";
+    tool.description = "Writer";
+    tool.inputSchema = Schema::object().build();
+    tool.handler = std::make_shared<EchoWriter>();
+    server->RegisterTool(tool);
+
+    MCPRequest req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"writer","arguments":{"message":"no","fail":true}}})");
+    MCPResponse res = server->handle(req);
+    JsonDocument body;
+    JsonVariantConst result = toolResult(server, res, body);
+
+    TEST_ASSERT_TRUE(result["isError"].as<bool>());
+    TEST_ASSERT_TRUE(result["structuredContent"].isNull());
+    JsonDocument payload;
+    TEST_ASSERT_FALSE(deserializeJson(payload, result["content"][0]["text"].as<const char*>()));
+    TEST_ASSERT_EQUAL_STRING("no", payload["echo"].as<const char*>());
+}
+
+struct Point {
+    double x = 0;
+    double y = 0;
+    static constexpr auto fields() {
+        return std::make_tuple(toolField("x", &Point::x), toolField("y", &Point::y));
+    }
+};
+
+struct PathArgs {
+    std::vector<Point> points;
+    String label;
+    uint8_t precision = 2;
+    static constexpr auto fields() {
+        return std::make_tuple(toolField("points", &PathArgs::points, "Vertices in order"),
+                               optionalToolField("label", &PathArgs::label),
+                               optionalToolField("precision", &PathArgs::precision));
+    }
+};
+
+struct PathResult {
+    double length = 0;
+    std::string label;
+    Point end;
+    static constexpr auto fields() {
+        return std::make_tuple(toolField("length", &PathResult::length), toolField("label", &PathResult::label),
+                               toolField("end", &PathResult::end));
+    }
+};
+
+static PathResult measurePath(const PathArgs& args, bool& isError) {
+    PathResult out;
+    isError = args.points.empty();
+    for (size_t i = 1; i < args.points.size(); ++i) {
+        out.length += std::hypot(args.points[i].x - args.points[i - 1].x, args.points[i].y - args.points[i - 1].y);
+    }
+    out.label = args.label.c_str();
+    if (!args.points.empty()) {
+        out.end = args.points.back();
+    }
+    return out;
+}
+
+void test_typed_tool_derives_schemas_and_binds_structs(void) {
+    server->RegisterTool<PathArgs, PathResult>("path", "Length of a path", measurePath);
+
+    JsonDocument input = server->inputSchemaOf("path");
+    TEST_ASSERT_EQUAL_STRING("array", input["properties"]["points"]["type"].as<const char*>());
+    TEST_ASSERT_EQUAL_STRING("Vertices in order", input["properties"]["points"]["description"].as<const char*>());
+    JsonVariantConst point = input["properties"]["points"]["items"];
+    TEST_ASSERT_EQUAL_STRING("number", point["properties"]["x"]["type"].as<const char*>());
+    TEST_ASSERT_EQUAL(2, point["required"].size());
+    TEST_ASSERT_EQUAL_STRING("integer", input["properties"]["precision"]["type"].as<const char*>());
+    TEST_ASSERT_EQUAL(0, input["properties"]["precision"]["minimum"].as<int>());
+    TEST_ASSERT_EQUAL(1, input["required"].size());
+    TEST_ASSERT_EQUAL_STRING("points", input["required"][0].as<const char*>());
+    TEST_ASSERT_NOT_NULL(strstr(server->toolsListJson()->c_str(), R"("outputSchema":{"type":"object")"));
+
+    MCPRequest req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"path","arguments":)"
+        R"({"label":"L","points":[{"x":0,"y":0},{"x":3,"y":4},{"x":3,"y":10}]}}})");
+    MCPResponse res = server->handle(req);
+    JsonDocument body;
+    JsonVariantConst result = toolResult(server, res, body);
+    TEST_ASSERT_FALSE(result["isError"].as<bool>());
+    JsonVariantConst structured = result["structuredContent"];
+    TEST_ASSERT_EQUAL_FLOAT(11.0f, structured["length"].as<float>());
+    TEST_ASSERT_EQUAL_STRING("L", structured["label"].as<const char*>());
+    TEST_ASSERT_EQUAL_FLOAT(10.0f, structured["end"]["y"].as<float>());
+
+    /* The function reports its own failures, and a value the validator lets
+     * through but the struct cannot hold fails the decode. Either way the
+     * payload reaches the client as text. */
+    req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":2,"method":"tools/call","params":{"name":"path","arguments":{"points":[]}}})");
+    res = server->handle(req);
+    result = toolResult(server, res, body);
+    TEST_ASSERT_TRUE(result["isError"].as<bool>());
+    TEST_ASSERT_TRUE(result["structuredContent"].isNull());
+    TEST_ASSERT_NOT_NULL(strstr(result["content"][0]["text"].as<const char*>(), "\"length\":0"));
+    req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":3,"method":"tools/call","params":{"name":"path","arguments":{"label":"L"}}})");
+    res = server->handle(req);
+    parseResponseBody(server, res, body);
+    TEST_ASSERT_EQUAL(static_cast<int>(ErrorCode::INVALID_PARAMS), body["error"]["code"].as<int>());
+    TEST_ASSERT_EQUAL_STRING("Invalid arguments: 'points' is required", body["error"]["message"].as<const char*>());
+    req = server->parseRequest(R"({"jsonrpc":"2.0","id":4,"method":"tools/call","params":{"name":"path",)"
+                               R"("arguments":{"points":[{"x":1,"y":1}],"precision":300}}})");
+    res = server->handle(req);
+    result = toolResult(server, res, body);
+    TEST_ASSERT_TRUE(result["isError"].as<bool>());
+    TEST_ASSERT_EQUAL_STRING(R"({"error":"arguments do not match the inputSchema"})",
+                             result["content"][0]["text"].as<const char*>());
+
+    // A whole number written as 3.0 is an integer to the validator, so the decode takes it too.
+    req = server->parseRequest(R"({"jsonrpc":"2.0","id":5,"method":"tools/call","params":{"name":"path",)"
+                               R"("arguments":{"points":[{"x":1,"y":1}],"precision":3.0}}})");
+    res = server->handle(req);
+    result = toolResult(server, res, body);
+    TEST_ASSERT_FALSE(result["isError"].as<bool>());
+    req = server->parseRequest(R"({"jsonrpc":"2.0","id":6,"method":"tools/call","params":{"name":"path",)"
+                               R"("arguments":{"points":[{"x":1,"y":1}],"precision":256.0}}})");
+    res = server->handle(req);
+    result = toolResult(server, res, body);
+    TEST_ASSERT_TRUE(result["isError"].as<bool>());
+}
+
+static void countCalls(void* context, JsonVariantConst arguments, JsonObject result, bool& isError) {
+    int& calls = *static_cast<int*>(context);
+    result["calls"] = ++calls;
+    result["echo"] = arguments["message"];
+    isError = false;
+}
+
+void test_function_handlers_are_held_by_value(void) {
+    int calls = 0;
+    Tool counted;
+    counted.name = "counted";
+    counted.description = "Function pointer with context";
+    counted.inputSchema = Schema::object().build();
+    counted.function = ToolFunction(countCalls, &calls);
+    server->RegisterTool(counted);
+
+    // Callables that would not fit, or take other arguments, are not ToolFunctions at all.
+    struct Oversized {
+        char bytes[ToolFunction::kInlineSize + 1];
+        void operator()(JsonVariantConst, JsonObject, bool&) {}
+    };
+    auto unary = [](JsonVariantConst) {};
+    static_assert(!std::is_convertible<Oversized, ToolFunction>::value, "oversized callable converted");
+    static_assert(!std::is_convertible<decltype(unary), ToolFunction>::value, "wrong signature converted");
+
+    const int offset = 40;
+    Tool offsetTool;
+    offsetTool.name = "offset";
+    offsetTool.description = "Inline lambda";
+    offsetTool.inputSchema = Schema::object().build();
+    offsetTool.function = [offset](JsonVariantConst arguments, JsonObject result, bool& isError) {
+        result["value"] = arguments["value"].as<int>() + offset;
+        isError = arguments["value"].isNull();
+    };
+    server->RegisterTool(offsetTool);
+
+    TEST_ASSERT_NULL(server->tools.find("counted")->second.handler.get());
+    for (int i = 1; i <= 2; ++i) {
+        MCPRequest req = server->parseRequest(R"({"jsonrpc":"2.0","id":1,"method":"tools/call",)"
+                                              R"("params":{"name":"counted","arguments":{"message":"hi"}}})");
+        MCPResponse res = server->handle(req);
+        JsonDocument body;
+        JsonVariantConst result = toolResult(server, res, body);
+        TEST_ASSERT_EQUAL(i, result["structuredContent"]["calls"].as<int>());
+        TEST_ASSERT_EQUAL_STRING("hi", result["structuredContent"]["echo"].as<const char*>());
+    }
+    TEST_ASSERT_EQUAL(2, calls);
+
+    MCPRequest req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":2,"method":"tools/call","params":{"name":"offset","arguments":{"value":2}}})");
+    MCPResponse res = server->handle(req);
+    JsonDocument body;
+    TEST_ASSERT_EQUAL(42, toolResult(server, res, body)["structuredContent"]["value"].as<int>());
+    req = server->parseRequest(R"({"jsonrpc":"2.0","id":3,"method":"tools/call","params":{"name":"offset"}})");
+    res = server->handle(req);
+    JsonVariantConst failed = toolResult(server, res, body);
+    TEST_ASSERT_TRUE(failed["isError"].as<bool>());
+    TEST_ASSERT_EQUAL_STRING(R"({"value":40})", failed["content"][0]["text"].as<const char*>());
+
+    // A small typed tool is stored the same way.
+    server->RegisterTool<PathArgs, PathResult>("path", "Length of a path", measurePath);
+    TEST_ASSERT_NULL(server->tools.find("path")->second.handler.get());
+    TEST_ASSERT_TRUE(static_cast<bool>(server->tools.find("path")->second.function));
+}
+
+// Counts the instances the lazy-handler test has built and not yet destroyed.
+class CountedHandler : public EchoHandler {
+public:
+    CountedHandler() {
+        ++built;
+        ++alive;
+        // Wide enough for a second first call to arrive while this one builds.
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    ~CountedHandler() override { --alive; }
+
+    static inline std::atomic<int> built{0};
+    static inline std::atomic<int> alive{0};
+};
+
+/* The echo a tools/call with message "hi" gets back, or empty. Asserts
+ * nothing, so it may run on a thread of its own. */
+static std::string callEcho(TestMCPServer* server, const char* tool) {
+    std::string json = std::string(R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":")") + tool +
+                       R"(","arguments":{"message":"hi"}}})";
+    MCPRequest req = server->parseRequest(json);
+    MCPResponse res = server->handle(req);
+    JsonDocument body;
+    deserializeJson(body, server->serializeResponse(res));
+    const char* echo = body["result"]["structuredContent"]["echo"].as<const char*>();
+    return echo ? echo : "";
+}
+
+void test_lazy_handler_is_built_on_first_call_and_evicted_when_idle(void) {
+    CountedHandler::built = 0;
+    CountedHandler::alive = 0;
+    mock_arduino::now = 1000;
+
+    Tool tool;
+    tool.name = "lazy";
+    tool.description = "Built on first use";
+    tool.inputSchema = Schema::object().build();
+    tool.factory = [] { return std::make_shared<CountedHandler>(); };
+    tool.idleTimeoutMs = 500;
+    server->RegisterTool(tool);
+    TEST_ASSERT_EQUAL(0, CountedHandler::built.load());
+
+    // Two first calls at once still build one handler, which later calls reuse.
+    std::string fromThread;
+    std::thread first([&fromThread] { fromThread = callEcho(server, "lazy"); });
+    TEST_ASSERT_EQUAL_STRING("hi", callEcho(server, "lazy").c_str());
+    first.join();
+    TEST_ASSERT_EQUAL_STRING("hi", fromThread.c_str());
+    TEST_ASSERT_EQUAL_STRING("hi", callEcho(server, "lazy").c_str());
+    TEST_ASSERT_EQUAL(1, CountedHandler::built.load());
+
+    mock_arduino::now += 499;
+    server->evictIdleHandlers();
+    TEST_ASSERT_EQUAL(1, CountedHandler::alive.load());
+    mock_arduino::now += 1;
+    server->evictIdleHandlers();
+    TEST_ASSERT_EQUAL(0, CountedHandler::alive.load());
+
+    TEST_ASSERT_EQUAL_STRING("hi", callEcho(server, "lazy").c_str());
+    TEST_ASSERT_EQUAL(2, CountedHandler::built.load());
+
+    // Without a timeout the handler is kept however long it sits unused.
+    tool.name = "kept";
+    tool.idleTimeoutMs = 0;
+    server->RegisterTool(tool);
+    TEST_ASSERT_EQUAL_STRING("hi", callEcho(server, "kept").c_str());
+    mock_arduino::now += 1000000;
+    server->evictIdleHandlers();
+    TEST_ASSERT_EQUAL(2, CountedHandler::alive.load());
+
+    // A factory that builds nothing is reported like a tool without a handler.
+    Tool broken;
+    broken.name = "broken";
+    broken.description = "Factory returns null";
+    broken.inputSchema = Schema::object().build();
+    broken.factory = [] { return std::shared_ptr<ToolHandler>(); };
+    server->RegisterTool(broken);
+    MCPRequest req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":2,"method":"tools/call","params":{"name":"broken","arguments":{}}})");
+    MCPResponse res = server->handle(req);
+    JsonDocument body;
+    parseResponseBody(server, res, body);
+    TEST_ASSERT_EQUAL(static_cast<int>(ErrorCode::INTERNAL_ERROR), body["error"]["code"].as<int>());
+    mock_arduino::now = 0;
+}
+
+void test_result_writer_still_answers_by_value_calls(void) {
+    EchoWriter writer;
+    ToolHandler& handler = writer;
+    JsonDocument args;
+    args["message"] = "direct";
+    JsonDocument result = handler.call(std::move(args));
+    TEST_ASSERT_EQUAL_STRING("direct", result["echo"].as<const char*>());
 }
 
 void test_structured_result_text_mirroring_follows_build_flag(void) {
@@ -473,10 +1686,12 @@ void test_structured_result_text_mirroring_follows_build_flag(void) {
     MCPRequest req = server->parseRequest(
         R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"echo","arguments":{"message":"hello"}}})");
     MCPResponse res = server->handle(req);
+    JsonDocument body;
+    JsonVariantConst result = toolResult(server, res, body);
 
-    TEST_ASSERT_EQUAL_STRING("hello", res.result()["structuredContent"]["echo"].as<const char*>());
+    TEST_ASSERT_EQUAL_STRING("hello", result["structuredContent"]["echo"].as<const char*>());
 
-    JsonArrayConst content = res.result()["content"].as<JsonArrayConst>();
+    JsonArrayConst content = result["content"].as<JsonArrayConst>();
 #if defined(MCP_OMIT_TEXT_WHEN_STRUCTURED) && MCP_OMIT_TEXT_WHEN_STRUCTURED
     TEST_ASSERT_EQUAL(0, content.size());
 #else
@@ -487,6 +1702,156 @@ void test_structured_result_text_mirroring_follows_build_flag(void) {
 #endif
 }
 
+void test_text_content_is_escaped_straight_from_the_payload(void) {
+    Tool tool;
+    tool.name = "quote";
+    tool.description = "Echo";
+    tool.inputSchema = Schema::object().build();
+    tool.handler = std::make_shared<EchoHandler>();
+    server->RegisterTool(tool);
+
+    MCPRequest req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"quote","arguments":{"message":"a\"b\\c\n/é"}}})");
+    MCPResponse res = server->handle(req);
+    JsonDocument body;
+    JsonVariantConst result = toolResult(server, res, body);
+
+#if !(defined(MCP_OMIT_TEXT_WHEN_STRUCTURED) && MCP_OMIT_TEXT_WHEN_STRUCTURED)
+    // No String copy of the text is kept in memory; it is written on output.
+    TEST_ASSERT_TRUE(res.result()["content"].isNull());
+    TEST_ASSERT_EQUAL_STRING("text", result["content"][0]["type"].as<const char*>());
+    TEST_ASSERT_EQUAL_STRING(R"({"echo":"a\"b\\c\n/é"})", result["content"][0]["text"].as<const char*>());
+#endif
+    TEST_ASSERT_EQUAL_STRING("a\"b\\c\n/é", result["structuredContent"]["echo"].as<const char*>());
+    TEST_ASSERT_FALSE(result["isError"].as<bool>());
+}
+
+static uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+/* Mostly plain text with every kind of byte mixed in — quotes, backslashes,
+ * all control characters including NUL, non-ASCII — and now and then a long
+ * clean run, so the word scan meets stop bytes at every alignment. */
+static std::string fuzzText(uint32_t& state) {
+    size_t length = nextRandom(state) % 8 == 0 ? 200 + nextRandom(state) % 2000 : nextRandom(state) % 40;
+    std::string text;
+    for (size_t i = 0; i < length; ++i) {
+        uint32_t r = nextRandom(state) % 20;
+        if (r == 0) {
+            text += '"';
+        } else if (r == 1) {
+            text += '\\';
+        } else if (r == 2) {
+            text += static_cast<char>(nextRandom(state) % 0x20);
+        } else if (r == 3) {
+            text += static_cast<char>(0x80 + nextRandom(state) % 0x80);
+        } else {
+            text += static_cast<char>(0x20 + nextRandom(state) % 0x5F);
+        }
+    }
+    return text;
+}
+
+/* The text content is the payload serialized and then escaped as a string.
+ * Built the slow way, through ArduinoJson, that is the reply serializeResponse
+ * must reproduce byte for byte. */
+static std::string referenceTextReply(int id, const JsonDocument& payload) {
+    std::string text;
+    serializeJson(payload, text);
+
+    JsonDocument expected;
+    expected["jsonrpc"] = "2.0";
+    expected["id"] = id;
+    JsonObject result = expected["result"].to<JsonObject>();
+    JsonObject item = result["content"].to<JsonArray>().add<JsonObject>();
+    item["type"] = "text";
+    item["text"] = text;
+    result["isError"] = false;
+
+    std::string reply;
+    serializeJson(expected, reply);
+    return reply;
+}
+
+static std::string callFixedTool(int id) {
+    char body[96];
+    snprintf(body, sizeof(body), R"({"jsonrpc":"2.0","id":%d,"method":"tools/call","params":{"name":"fixed"}})", id);
+    MCPRequest req = server->parseRequest(body);
+    return server->serializeResponse(server->handle(req));
+}
+
+void test_text_content_escaping_matches_arduinojson(void) {
+    auto handler = std::make_shared<FixedResultHandler>();
+    Tool tool;
+    tool.name = "fixed";
+    tool.description = "Fixed result";
+    tool.inputSchema = Schema::object().build();
+    tool.handler = handler;
+    server->RegisterTool(tool);
+
+    // An array result is not structured, so it is sent as text in both builds.
+    uint32_t state = 0x2545F491u;
+    for (int id = 1; id <= 300; ++id) {
+        JsonArray payload = handler->result.to<JsonArray>();
+        payload.add(fuzzText(state));
+        std::string key = fuzzText(state);
+        key.erase(std::remove(key.begin(), key.end(), '\0'), key.end());
+        payload.add<JsonObject>()[key] = fuzzText(state);
+
+        std::string expected = referenceTextReply(id, handler->result);
+        std::string actual = callFixedTool(id);
+        TEST_ASSERT_EQUAL_size_t(expected.size(), actual.size());
+        TEST_ASSERT_TRUE(expected == actual);
+    }
+}
+
+void test_text_escaping_benchmark(void) {
+    /* Reports rather than asserts: 16 KiB of CSV-like log text, escaped twice
+     * over as text content, against ArduinoJson producing the same reply. */
+    auto handler = std::make_shared<FixedResultHandler>();
+    Tool tool;
+    tool.name = "fixed";
+    tool.description = "Fixed result";
+    tool.inputSchema = Schema::object().build();
+    tool.handler = handler;
+    server->RegisterTool(tool);
+
+    std::string log;
+    while (log.size() < 16 * 1024) {
+        log += "2025-06-18T12:00:00Z,sensor-3,21.50,\"ok\",heap=182304\n";
+    }
+    handler->result.set(log);
+    const std::string expected = referenceTextReply(1, handler->result);
+
+    MCPRequest req = server->parseRequest(R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"fixed"}})");
+    MCPResponse res = server->handle(req);
+
+    const int rounds = 50;
+    std::string actual;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        actual = server->serializeResponse(res);
+    }
+    auto ours = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        std::string reference = referenceTextReply(1, handler->result);
+    }
+    auto theirs = std::chrono::steady_clock::now() - start;
+
+    TEST_ASSERT_TRUE(expected == actual);
+    char message[128];
+    snprintf(message, sizeof(message), "16 KiB text reply: %lld us to serialize (ArduinoJson: %lld us)",
+             static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(ours).count() / rounds),
+             static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(theirs).count() / rounds));
+    TEST_MESSAGE(message);
+}
+
 void test_handle_tool_call_handler_reports_execution_error(void) {
     Tool tool;
     tool.name = "flaky";
@@ -498,15 +1863,17 @@ void test_handle_tool_call_handler_reports_execution_error(void) {
     MCPRequest req = server->parseRequest(
         R"({"jsonrpc":"2.0","id":7,"method":"tools/call","params":{"name":"flaky","arguments":{}}})");
     MCPResponse res = server->handle(req);
+    JsonDocument body;
+    JsonVariantConst result = toolResult(server, res, body);
 
     /* Per MCP, an execution failure is a RESULT with isError=true so the LLM
      * can see it — not a JSON-RPC protocol error. */
     TEST_ASSERT_EQUAL(200, res.code);
     TEST_ASSERT_TRUE(res.hasResult());
     TEST_ASSERT_FALSE(res.hasError());
-    TEST_ASSERT_TRUE(res.result()["isError"].as<bool>());
+    TEST_ASSERT_TRUE(result["isError"].as<bool>());
 
-    JsonArrayConst content = res.result()["content"].as<JsonArrayConst>();
+    JsonArrayConst content = result["content"].as<JsonArrayConst>();
     TEST_ASSERT_EQUAL(1, content.size());
     TEST_ASSERT_EQUAL_STRING("text", content[0]["type"].as<const char*>());
     JsonDocument textDoc;
@@ -514,7 +1881,7 @@ void test_handle_tool_call_handler_reports_execution_error(void) {
     TEST_ASSERT_EQUAL_STRING("sensor offline", textDoc["error"].as<const char*>());
 
     /* Error payloads would not conform to a declared outputSchema. */
-    TEST_ASSERT_TRUE(res.result()["structuredContent"].isNull());
+    TEST_ASSERT_TRUE(result["structuredContent"].isNull());
 }
 
 void test_handle_tool_call_scalar_result_has_no_structured_content(void) {
@@ -528,14 +1895,16 @@ void test_handle_tool_call_scalar_result_has_no_structured_content(void) {
     MCPRequest req = server->parseRequest(
         R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"scalar","arguments":{}}})");
     MCPResponse res = server->handle(req);
+    JsonDocument body;
+    JsonVariantConst result = toolResult(server, res, body);
 
     TEST_ASSERT_TRUE(res.hasResult());
-    TEST_ASSERT_FALSE(res.result()["isError"].as<bool>());
+    TEST_ASSERT_FALSE(result["isError"].as<bool>());
     /* The value still reaches the client as serialized text content... */
-    TEST_ASSERT_EQUAL_STRING("42", res.result()["content"][0]["text"].as<const char*>());
+    TEST_ASSERT_EQUAL_STRING("42", result["content"][0]["text"].as<const char*>());
     /* ...but structuredContent is defined as a JSON object by MCP, so a
      * non-object result must not be attached. */
-    TEST_ASSERT_TRUE(res.result()["structuredContent"].isNull());
+    TEST_ASSERT_TRUE(result["structuredContent"].isNull());
 }
 
 void test_handle_tool_call_missing_name(void) {
@@ -597,9 +1966,10 @@ void test_handle_parse_error(void) {
 /* ======== serializeResponse ======== */
 
 void test_serialize_response_with_result(void) {
-    MCPResponse res;
-    res.idDoc.set(1);
-    res.resultDoc["value"] = "test";
+    JsonDocument id;
+    id.set(1);
+    MCPResponse res(200, id.as<JsonVariantConst>());
+    res.resultDoc()["value"] = "test";
 
     std::string json = server->serializeResponse(res);
 
@@ -627,8 +1997,9 @@ void test_serialize_response_with_error(void) {
 }
 
 void test_serialize_includes_jsonrpc_version(void) {
-    MCPResponse res;
-    res.idDoc.set(99);
+    JsonDocument id;
+    id.set(99);
+    MCPResponse res(200, id.as<JsonVariantConst>());
 
     std::string json = server->serializeResponse(res);
 
@@ -712,7 +2083,7 @@ void test_response_code_id_constructor(void) {
 
 void test_request_default_state(void) {
     MCPRequest req;
-    TEST_ASSERT_EQUAL_STRING("", req.method.c_str());
+    TEST_ASSERT_TRUE(MCPMethod::NONE == req.method);
     TEST_ASSERT_FALSE(req.hasParams());
     TEST_ASSERT_TRUE(req.id().isNull());
 }
@@ -762,11 +2133,13 @@ void test_handle_tool_call_empty_arguments(void) {
     MCPRequest req = server->parseRequest(
         R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"inspect","arguments":{}}})");
     MCPResponse res = server->handle(req);
+    JsonDocument body;
+    JsonVariantConst result = toolResult(server, res, body);
 
     TEST_ASSERT_EQUAL(200, res.code);
     TEST_ASSERT_TRUE(res.hasResult());
 
-    JsonArrayConst content = res.result()["content"].as<JsonArrayConst>();
+    JsonArrayConst content = result["content"].as<JsonArrayConst>();
     JsonDocument textDoc;
     deserializeJson(textDoc, content[0]["text"].as<const char*>());
     TEST_ASSERT_EQUAL(0, textDoc["param_count"].as<int>());
@@ -783,11 +2156,13 @@ void test_handle_tool_call_complex_result(void) {
     MCPRequest req = server->parseRequest(
         R"({"jsonrpc":"2.0","id":7,"method":"tools/call","params":{"name":"complex","arguments":{}}})");
     MCPResponse res = server->handle(req);
+    JsonDocument body;
+    JsonVariantConst result = toolResult(server, res, body);
 
     TEST_ASSERT_EQUAL(200, res.code);
 
     JsonDocument payload;
-    readToolPayload(res.result(), payload);
+    readToolPayload(result, payload);
     TEST_ASSERT_EQUAL_STRING("ok", payload["status"].as<const char*>());
     TEST_ASSERT_EQUAL(3, payload["items"].as<JsonArrayConst>().size());
     TEST_ASSERT_EQUAL_STRING("value", payload["nested"]["key"].as<const char*>());
@@ -804,11 +2179,13 @@ void test_handle_tool_call_empty_result(void) {
     MCPRequest req = server->parseRequest(
         R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"empty","arguments":{}}})");
     MCPResponse res = server->handle(req);
+    JsonDocument body;
+    JsonVariantConst result = toolResult(server, res, body);
 
     TEST_ASSERT_EQUAL(200, res.code);
     TEST_ASSERT_TRUE(res.hasResult());
     /* Content should still have one text entry */
-    JsonArrayConst content = res.result()["content"].as<JsonArrayConst>();
+    JsonArrayConst content = result["content"].as<JsonArrayConst>();
     TEST_ASSERT_EQUAL(1, content.size());
 }
 
@@ -833,8 +2210,8 @@ void test_handle_tool_call_multiple_different_tools(void) {
         R"({"jsonrpc":"2.0","id":1,"method":"tools/call","params":{"name":"echo","arguments":{"message":"hi"}}})");
     MCPResponse res1 = server->handle(req1);
     TEST_ASSERT_TRUE(res1.hasResult());
-    JsonDocument doc1;
-    readToolPayload(res1.result(), doc1);
+    JsonDocument body1, doc1;
+    readToolPayload(toolResult(server, res1, body1), doc1);
     TEST_ASSERT_EQUAL_STRING("hi", doc1["echo"].as<const char*>());
 
     /* Call complex */
@@ -842,8 +2219,8 @@ void test_handle_tool_call_multiple_different_tools(void) {
         R"({"jsonrpc":"2.0","id":2,"method":"tools/call","params":{"name":"complex","arguments":{}}})");
     MCPResponse res2 = server->handle(req2);
     TEST_ASSERT_TRUE(res2.hasResult());
-    JsonDocument doc2;
-    readToolPayload(res2.result(), doc2);
+    JsonDocument body2, doc2;
+    readToolPayload(toolResult(server, res2, body2), doc2);
     TEST_ASSERT_EQUAL_STRING("ok", doc2["status"].as<const char*>());
 }
 
@@ -954,24 +2331,66 @@ void test_handle_tools_list_complex_schemas(void) {
 void test_parse_null_id(void) {
     MCPRequest req = server->parseRequest(
         R"({"jsonrpc":"2.0","id":null,"method":"initialize","params":{}})");
-    TEST_ASSERT_EQUAL_STRING("initialize", req.method.c_str());
+    TEST_ASSERT_TRUE(MCPMethod::INITIALIZE == req.method);
     TEST_ASSERT_TRUE(req.id().isNull());
 }
 
 void test_parse_zero_id(void) {
     MCPRequest req = server->parseRequest(
         R"({"jsonrpc":"2.0","id":0,"method":"tools/list"})");
-    TEST_ASSERT_EQUAL_STRING("tools/list", req.method.c_str());
+    TEST_ASSERT_TRUE(MCPMethod::TOOLS_LIST == req.method);
     TEST_ASSERT_EQUAL(0, req.id().as<int>());
 }
 
 void test_parse_negative_id(void) {
     MCPRequest req = server->parseRequest(
         R"({"jsonrpc":"2.0","id":-1,"method":"tools/list"})");
-    TEST_ASSERT_EQUAL_STRING("tools/list", req.method.c_str());
+    TEST_ASSERT_TRUE(MCPMethod::TOOLS_LIST == req.method);
     TEST_ASSERT_EQUAL(-1, req.id().as<int>());
 }
 
+void test_ids_are_echoed_verbatim(void) {
+    // Spills past the inline buffer, and carries an escape.
+    MCPRequest req = server->parseRequest(
+        R"({"jsonrpc":"2.0","id":"a-rather-long-request-id-\"quoted\"","method":"ping"})");
+    TEST_ASSERT_TRUE(MCPId::Kind::STRING == req.id().kind());
+    TEST_ASSERT_EQUAL_STRING("a-rather-long-request-id-\"quoted\"", req.id().as<const char*>());
+    std::string json = server->serializeResponse(server->handle(req));
+    TEST_ASSERT_NOT_NULL(strstr(json.c_str(), R"("id":"a-rather-long-request-id-\"quoted\"")"));
+
+    // A number goes back exactly as it came, not reformatted.
+    req = server->parseRequest(R"({"jsonrpc":"2.0","id":1.50e3,"method":"ping"})");
+    TEST_ASSERT_EQUAL(1500, req.id().as<int>());
+    json = server->serializeResponse(server->handle(req));
+    TEST_ASSERT_NOT_NULL(strstr(json.c_str(), R"("id":1.50e3)"));
+}
+
+void test_request_and_reply_are_compact(void) {
+    TEST_ASSERT_TRUE(sizeof(MCPId) <= 32);
+    // One body slot, whichever of result, raw result or error it holds.
+    const size_t slot = sizeof(JsonDocument) > sizeof(PlacedString) ? sizeof(JsonDocument) : sizeof(PlacedString);
+    TEST_ASSERT_TRUE(sizeof(MCPResponse) <= slot + sizeof(MCPId) + 2 * sizeof(int));
+    TEST_ASSERT_TRUE(sizeof(MCPRequest) <=
+                     sizeof(JsonDocument) + sizeof(MCPId) + sizeof(std::string) + 2 * sizeof(size_t) + 8);
+
+    char report[128];
+    snprintf(report, sizeof(report), "MCPId %u bytes, MCPRequest %u, MCPResponse %u", (unsigned)sizeof(MCPId),
+             (unsigned)sizeof(MCPRequest), (unsigned)sizeof(MCPResponse));
+    TEST_MESSAGE(report);
+}
+
+void test_ping_with_short_id_allocates_nothing(void) {
+    CountingAllocator heap;
+    {
+        MCPArena::Scope scope(&heap);
+        MCPRequest req = server->parseRequest(R"({"jsonrpc":"2.0","id":"req-1","method":"ping"})");
+        MCPResponse res = server->handle(req);
+        TEST_ASSERT_EQUAL_STRING(R"({"jsonrpc":"2.0","id":"req-1","result":{}})",
+                                 server->serializeResponse(res).c_str());
+    }
+    TEST_ASSERT_EQUAL(0, heap.allocations);
+}
+
 /* ======== handle: ping ======== */
 
 void test_handle_ping_returns_empty_result(void) {
@@ -1099,6 +2518,11 @@ int main(int argc, char** argv) {
     RUN_TEST(test_parse_empty_string);
     RUN_TEST(test_parse_no_params);
     RUN_TEST(test_parse_with_arguments);
+    RUN_TEST(test_parse_tools_call_builds_only_arguments);
+    RUN_TEST(test_scan_builds_no_tree_until_materialized);
+    RUN_TEST(test_unknown_method_params_are_never_built);
+    RUN_TEST(test_parse_member_order_and_escapes_do_not_matter);
+    RUN_TEST(test_parse_rejects_what_deserialize_json_rejects);
     RUN_TEST(test_invalid_jsonrpc_envelope_is_rejected);
 
     /* handle: initialize */
@@ -1128,12 +2552,42 @@ int main(int argc, char** argv) {
     RUN_TEST(test_handle_tools_list_with_output_schema);
 
     /* handle: tools/call */
+    RUN_TEST(test_argument_filter_drops_undeclared_fields);
+    RUN_TEST(test_argument_filter_follows_nested_objects_and_arrays);
+    RUN_TEST(test_argument_filter_respects_additional_properties);
+    RUN_TEST(test_arguments_are_checked_against_the_input_schema);
+    RUN_TEST(test_arguments_are_checked_when_handled_directly);
+    RUN_TEST(test_inclusive_and_exclusive_bounds_are_both_enforced);
+    RUN_TEST(test_schemas_that_constrain_nothing_get_no_validator);
+    RUN_TEST(test_argument_validation_benchmark);
     RUN_TEST(test_handle_tool_call_success);
+    RUN_TEST(test_handle_tool_call_moves_arguments_into_the_handler);
+    RUN_TEST(test_request_arena_cuts_mallocs_per_request);
+    RUN_TEST(test_by_value_handler_may_keep_params_past_the_arena);
+    RUN_TEST(test_request_arena_grows_and_releases_blocks);
+    RUN_TEST(test_result_writer_builds_in_place);
+    RUN_TEST(test_result_writer_failure_is_sent_as_text_only);
+    RUN_TEST(test_result_writer_still_answers_by_value_calls);
+    RUN_TEST(test_typed_tool_derives_schemas_and_binds_structs);
+    RUN_TEST(test_function_handlers_are_held_by_value);
+    RUN_TEST(test_lazy_handler_is_built_on_first_call_and_evicted_when_idle);
+    RUN_TEST(test_text_content_is_escaped_straight_from_the_payload);
+    RUN_TEST(test_text_content_escaping_matches_arduinojson);
+    RUN_TEST(test_text_escaping_benchmark);
     RUN_TEST(test_handle_tool_call_handler_reports_execution_error);
     RUN_TEST(test_handle_tool_call_scalar_result_has_no_structured_content);
     RUN_TEST(test_structured_result_text_mirroring_follows_build_flag);
     RUN_TEST(test_tools_list_body_is_cached_between_calls);
+    RUN_TEST(test_registered_schemas_are_kept_as_text);
+    RUN_TEST(test_tools_list_reuses_cached_tool_entries);
+    RUN_TEST(test_tools_list_replies_share_the_cached_buffer);
+    RUN_TEST(test_static_schemas_are_spliced_without_a_copy);
+    RUN_TEST(test_literal_tool_metadata_is_not_copied);
+    RUN_TEST(test_static_tool_table_is_listed_in_place);
+    RUN_TEST(test_static_tool_table_is_listed_after_registered_tools);
+    RUN_TEST(test_tools_list_is_paged_with_cursors);
     RUN_TEST(test_registering_a_tool_invalidates_the_tools_list_cache);
+    RUN_TEST(test_large_tools_list_is_placed_in_psram);
     RUN_TEST(test_register_tool_move_overload_registers_and_invalidates);
     RUN_TEST(test_handle_tool_call_missing_name);
     RUN_TEST(test_handle_tool_call_unknown_tool);
@@ -1187,6 +2641,9 @@ int main(int argc, char** argv) {
     RUN_TEST(test_parse_null_id);
     RUN_TEST(test_parse_zero_id);
     RUN_TEST(test_parse_negative_id);
+    RUN_TEST(test_ids_are_echoed_verbatim);
+    RUN_TEST(test_request_and_reply_are_compact);
+    RUN_TEST(test_ping_with_short_id_allocates_nothing);
 
     return UNITY_END();
 }
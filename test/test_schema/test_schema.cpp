@@ -1,6 +1,8 @@
 #include <unity.h>
 
 #include <ArduinoJson.h>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
 #include "MCPServer.h"
@@ -250,6 +252,222 @@ void test_property_schemas_are_copied_not_aliased(void) {
     TEST_ASSERT_EQUAL_STRING("original", doc["properties"]["field"]["description"].as<const char*>());
 }
 
+void test_repeated_items_and_properties_replace_in_place(void) {
+    JsonDocument doc;
+    serializeSchema(Schema::object()
+                        .property("a", Schema::string())
+                        .property("b", Schema::integer())
+                        .property("a", Schema::boolean())
+                        .property("list", Schema::array().items(Schema::string()).items(Schema::number())),
+                    doc);
+
+    JsonObjectConst properties = doc["properties"].as<JsonObjectConst>();
+    TEST_ASSERT_EQUAL_UINT(3, properties.size());
+    TEST_ASSERT_EQUAL_STRING("a", properties.begin()->key().c_str());
+    TEST_ASSERT_EQUAL_STRING("boolean", properties["a"]["type"].as<const char*>());
+    TEST_ASSERT_EQUAL_STRING("number", properties["list"]["items"]["type"].as<const char*>());
+}
+
+/* ======== Build cost ======== */
+
+/* Counts what the builder asks of the heap, through MCPArena::Scope. */
+class CountingAllocator : public ArduinoJson::Allocator {
+public:
+    size_t allocations = 0;
+    size_t bytes = 0;
+
+    void* allocate(size_t size) override {
+        allocations++;
+        bytes += size;
+        return malloc(size);
+    }
+    void deallocate(void* ptr) override { free(ptr); }
+    void* reallocate(void* ptr, size_t newSize) override {
+        allocations++;
+        bytes += newSize;
+        return realloc(ptr, newSize);
+    }
+};
+
+/* Five nested objects of ten properties each: nine described strings and,
+ * above the last level, one more object. */
+static constexpr int kLevels = 5;
+static constexpr int kPropertiesPerLevel = 10;
+
+static Schema linkedLevel(int level) {
+    Schema schema = Schema::object();
+    char name[16], description[32];
+    for (int i = 0; i < kPropertiesPerLevel - 1; ++i) {
+        snprintf(name, sizeof(name), "p%d_%d", level, i);
+        snprintf(description, sizeof(description), "property %d of level %d", i, level);
+        schema.property(name, Schema::string().description(description));
+    }
+    if (level < kLevels) {
+        schema.property("child", linkedLevel(level + 1));
+    } else {
+        schema.property("leaf", Schema::string());
+    }
+    return schema;
+}
+
+// The same schema built the way the builder used to: one document per node,
+// each copied into its parent.
+static JsonDocument copiedLevel(ArduinoJson::Allocator* allocator, int level) {
+    JsonDocument schema(allocator);
+    schema["type"] = "object";
+    JsonObject properties = schema["properties"].to<JsonObject>();
+    char name[16], description[32];
+    for (int i = 0; i < kPropertiesPerLevel - 1; ++i) {
+        snprintf(name, sizeof(name), "p%d_%d", level, i);
+        snprintf(description, sizeof(description), "property %d of level %d", i, level);
+        JsonDocument property(allocator);
+        property["type"] = "string";
+        property["description"] = description;
+        properties[name].set(property);
+    }
+    if (level < kLevels) {
+        properties["child"].set(copiedLevel(allocator, level + 1));
+    } else {
+        JsonDocument leaf(allocator);
+        leaf["type"] = "string";
+        properties["leaf"].set(leaf);
+    }
+    return schema;
+}
+
+void test_nested_schema_is_built_without_copying_each_level(void) {
+    CountingAllocator linkedHeap;
+    JsonDocument linked;
+    {
+        MCPArena::Scope scope(&linkedHeap);
+        linked = linkedLevel(1).build();
+    }
+
+    CountingAllocator copiedHeap;
+    JsonDocument copied;
+    {
+        JsonDocument built = copiedLevel(&copiedHeap, 1);
+        copied.set(built);
+    }
+
+    std::string linkedJson, copiedJson;
+    serializeJson(linked, linkedJson);
+    serializeJson(copied, copiedJson);
+    TEST_ASSERT_EQUAL_STRING(copiedJson.c_str(), linkedJson.c_str());
+    TEST_ASSERT_EQUAL_STRING(
+        "string",
+        linked["properties"]["child"]["properties"]["child"]["properties"]["child"]["properties"]["child"]
+              ["properties"]["leaf"]["type"].as<const char*>());
+
+    char report[160];
+    snprintf(report, sizeof(report),
+             "%d levels x %d properties: linked %u allocations / %u bytes, copied per level %u / %u",
+             kLevels, kPropertiesPerLevel, (unsigned)linkedHeap.allocations, (unsigned)linkedHeap.bytes,
+             (unsigned)copiedHeap.allocations, (unsigned)copiedHeap.bytes);
+    TEST_MESSAGE(report);
+    TEST_ASSERT_LESS_THAN(copiedHeap.bytes, linkedHeap.bytes);
+    TEST_ASSERT_LESS_THAN(copiedHeap.allocations, linkedHeap.allocations);
+}
+
+/* Counts the blocks still held, so a test can tell a store that reuses
+ * freed nodes from one that only grows. */
+class LiveBlockAllocator : public ArduinoJson::Allocator {
+public:
+    long live = 0;
+
+    void* allocate(size_t size) override {
+        ++live;
+        return malloc(size);
+    }
+    void deallocate(void* ptr) override {
+        --live;
+        free(ptr);
+    }
+    void* reallocate(void* ptr, size_t newSize) override { return realloc(ptr, newSize); }
+};
+
+void test_kept_schema_does_not_make_the_store_grow(void) {
+    LiveBlockAllocator heap;
+    MCPArena::Scope scope(&heap);
+    // Kept for the whole test, and with it the thread's store.
+    Schema kept = Schema::object().property("kept", Schema::string().description("pins the store"));
+
+    linkedLevel(kLevels).build();
+    const long afterOne = heap.live;
+    for (int i = 0; i < 50; ++i) {
+        linkedLevel(kLevels).build();
+    }
+    TEST_ASSERT_EQUAL(afterOne, heap.live);
+
+    JsonDocument doc;
+    serializeSchema(kept, doc);
+    TEST_ASSERT_EQUAL_STRING("pins the store", doc["properties"]["kept"]["description"].as<const char*>());
+}
+
+void test_schema_built_in_an_arena_outlives_it(void) {
+    JsonDocument built;
+    {
+        MCPArena arena;
+        MCPArena::Scope scope(&arena);
+        built = linkedLevel(kLevels).build();
+        TEST_ASSERT_GREATER_THAN(0, arena.blockCount());
+    }
+    TEST_ASSERT_EQUAL_STRING("property 0 of level 5",
+                             built["properties"]["p5_0"]["description"].as<const char*>());
+}
+
+/* ======== Compile-time schemas ======== */
+
+static constexpr bool sameText(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        ++a;
+        ++b;
+    }
+    return *a == *b;
+}
+
+// Checked while compiling: the literal is exact, and escaped like ArduinoJson.
+static constexpr auto kQuoted = schemaLiteral([] { return StaticSchema::string().description("Say \"hi\"\n"); });
+static_assert(sameText(kQuoted.c_str(), R"({"type":"string","description":"Say \"hi\"\n"})"), "escaped text");
+static_assert(sizeof(kQuoted) <= sizeof(R"({"type":"string","description":"Say \"hi\"\n"})") + sizeof(size_t) * 2,
+              "no room left over");
+
+static constexpr auto kTool = schemaLiteral([] {
+    return StaticSchema::object()
+        .description("Tool parameters")
+        .property("text", StaticSchema::string().minLength(1).maxLength(64).defaultValue("hello"))
+        .property("mode", StaticSchema::string().enumValues("fast", "slow"))
+        .property("level", StaticSchema::integer().minimum(-5).maximum(5).enumValues(-5, 0, 5).defaultValue(0))
+        .property("tags", StaticSchema::array().items(StaticSchema::string()).maxItems(8))
+        .property("flag", StaticSchema::boolean().defaultValue(false))
+        .property("either", StaticSchema::object().oneOf(StaticSchema::string(), StaticSchema::null()))
+        .additionalProperties(false)
+        .required("text", "mode");
+});
+
+void test_static_schema_matches_the_runtime_builder(void) {
+    JsonDocument literal;
+    TEST_ASSERT_FALSE(deserializeJson(literal, kTool.c_str()));
+
+    JsonDocument runtime;
+    serializeSchema(Schema::object()
+                        .description("Tool parameters")
+                        .property("text", Schema::string().minLength(1).maxLength(64).defaultValue("hello"))
+                        .property("mode", Schema::string().enumValues({"fast", "slow"}))
+                        .property("level", Schema::integer().minimum(-5).maximum(5).enumValues({-5, 0, 5}).defaultValue(0))
+                        .property("tags", Schema::array().items(Schema::string()).maxItems(8))
+                        .property("flag", Schema::boolean().defaultValue(false))
+                        .property("either", Schema::object().oneOf({Schema::string(), Schema::null()}))
+                        .additionalProperties(false)
+                        .required({"text", "mode"}),
+                    runtime);
+
+    // Members are compared by name: the literal writes properties last.
+    TEST_ASSERT_TRUE(literal.as<JsonVariantConst>() == runtime.as<JsonVariantConst>());
+    TEST_ASSERT_EQUAL_INT(-5, literal["properties"]["level"]["minimum"].as<int>());
+    TEST_ASSERT_TRUE(literal["properties"]["flag"]["default"].is<bool>());
+}
+
 int main(int argc, char** argv) {
     (void)argc;
     (void)argv;
@@ -271,5 +489,10 @@ int main(int argc, char** argv) {
     RUN_TEST(test_one_of_any_of_all_of);
     RUN_TEST(test_default_constructed_schema_is_unconstrained);
     RUN_TEST(test_property_schemas_are_copied_not_aliased);
+    RUN_TEST(test_repeated_items_and_properties_replace_in_place);
+    RUN_TEST(test_nested_schema_is_built_without_copying_each_level);
+    RUN_TEST(test_kept_schema_does_not_make_the_store_grow);
+    RUN_TEST(test_schema_built_in_an_arena_outlives_it);
+    RUN_TEST(test_static_schema_matches_the_runtime_builder);
     return UNITY_END();
 }